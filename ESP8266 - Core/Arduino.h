@@ -176,6 +176,8 @@ void AnalogWriteMode(uint8_t pin, int val, bool openDrain);
 void AnalogWriteFreq(uint32_t freq);
 void AnalogWriteResolution(int res);
 void AnalogWriteRange(uint32_t range);
+bool AnalogWriteMulti(const uint8_t *pins, const int *vals, uint8_t count);
+bool AnalogWritePhase(uint8_t pin, int phase);
 
 unsigned long PulseIn(uint8_t pin, uint8_t state, unsigned long timeout);
 unsigned long PulseInLong(uint8_t pin, uint8_t state, unsigned long timeout);
@@ -187,6 +189,19 @@ void AttachInterrupt(uint8_t pin, void (*)(void), int mode);
 void detachInterrupt(uint8_t pin);
 void AttachInterruptArg(uint8_t pin, void (*)(void*), void* arg, int mode);
 
+// Edge capture: instead of calling an ISR, every edge on the pin is queued with
+// its level and the cycle count of the interrupt, to be read outside the ISR.
+// Edges pending together share one GPI read and one timestamp.
+typedef struct {
+  uint8_t pin;
+  uint8_t level;
+  uint32_t ccount;
+} gpio_edge_t;
+
+void AttachCaptureInterrupt(uint8_t pin, int mode);
+bool ReadCapturedEdge(gpio_edge_t* edge);
+uint32_t CapturedEdgesDropped(void);
+
 #if FLASH_MAP_SUPPORT
 #include "flash_hal.h"
 #endif
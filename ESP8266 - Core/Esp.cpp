@@ -26,6 +26,7 @@
 #include "MD5Builder.h"
 #include "umm_malloc/umm_malloc.h"
 #include "cont.h"
+#include "StackThunk.h"
 #include "flash_hal.h"
 #include "coredecls.h"
 #include "umm_malloc/umm_malloc.h"
@@ -45,6 +46,34 @@ extern struct rst_info resetInfo;
   #define PUYA_SUPPORT 1
 #endif
 
+// The spi_flash operations, timed for flash_hal_get_stats() with FLASH_HAL_STATS
+#if FLASH_HAL_STATS
+static SpiFlashOpResult timed_spi_flash_read(uint32_t address, uint32_t *data, uint32_t size) {
+    const uint32_t start = micros();
+    SpiFlashOpResult rc = spi_flash_read(address, data, size);
+    flash_hal_stats_record(FLASH_HAL_OP_READ, size, micros() - start);
+    return rc;
+}
+
+static SpiFlashOpResult timed_spi_flash_write(uint32_t address, uint32_t *data, uint32_t size) {
+    const uint32_t start = micros();
+    SpiFlashOpResult rc = spi_flash_write(address, data, size);
+    flash_hal_stats_record(FLASH_HAL_OP_WRITE, size, micros() - start);
+    return rc;
+}
+
+static SpiFlashOpResult timed_spi_flash_erase_sector(uint16_t sector) {
+    const uint32_t start = micros();
+    SpiFlashOpResult rc = spi_flash_erase_sector(sector);
+    flash_hal_stats_record(FLASH_HAL_OP_ERASE, SPI_FLASH_SEC_SIZE, micros() - start);
+    return rc;
+}
+#else
+#define timed_spi_flash_read spi_flash_read
+#define timed_spi_flash_write spi_flash_write
+#define timed_spi_flash_erase_sector spi_flash_erase_sector
+#endif
+
 /**
  * User-defined Literals
  *  usage:
@@ -239,6 +268,16 @@ void EspClass::resetFreeContStack()
     cont_repaint_stack(g_pcont);
 }
 
+void EspClass::getStackThunkStats(uint32_t* size, uint32_t* used, uint32_t* peak)
+{
+    if (size)
+        *size = stack_thunk_get_stack_bot() ? stack_thunk_get_size() : 0;
+    if (used)
+        *used = stack_thunk_get_max_usage();
+    if (peak)
+        *peak = stack_thunk_get_peak_usage();
+}
+
 uint32_t EspClass::getChipId(void)
 {
     return system_get_chip_id();
@@ -299,7 +338,7 @@ uint32_t EspClass::getFlashChipSize(void)
     uint32_t data;
     uint8_t * bytes = (uint8_t *) &data;
     // read first 4 byte (magic byte + flash config)
-    if(spi_flash_read(0x0000, &data, 4) == SPI_FLASH_RESULT_OK) {
+    if(timed_spi_flash_read(0x0000, &data, 4) == SPI_FLASH_RESULT_OK) {
         return magicFlashChipSize((bytes[3] & 0xf0) >> 4);
     }
     return 0;
@@ -311,7 +350,7 @@ uint32_t EspClass::getFlashChipSpeed(void)
     uint32_t data;
     uint8_t * bytes = (uint8_t *) &data;
     // read first 4 byte (magic byte + flash config)
-    if(spi_flash_read(0x0000, &data, 4) == SPI_FLASH_RESULT_OK) {
+    if(timed_spi_flash_read(0x0000, &data, 4) == SPI_FLASH_RESULT_OK) {
         return magicFlashChipSpeed(bytes[3] & 0x0F);
     }
     return 0;
@@ -323,7 +362,7 @@ FlashMode_t EspClass::getFlashChipMode(void)
     uint32_t data;
     uint8_t * bytes = (uint8_t *) &data;
     // read first 4 byte (magic byte + flash config)
-    if(spi_flash_read(0x0000, &data, 4) == SPI_FLASH_RESULT_OK) {
+    if(timed_spi_flash_read(0x0000, &data, 4) == SPI_FLASH_RESULT_OK) {
         mode = magicFlashChipMode(bytes[2]);
     }
     return mode;
@@ -595,7 +634,7 @@ uint32_t EspClass::getSketchSize() {
 
     image_header_t image_header;
     uint32_t pos = APP_START_OFFSET;
-    if (spi_flash_read(pos, (uint32_t*) &image_header, sizeof(image_header)) != SPI_FLASH_RESULT_OK) {
+    if (timed_spi_flash_read(pos, (uint32_t*) &image_header, sizeof(image_header)) != SPI_FLASH_RESULT_OK) {
         return 0;
     }
     pos += sizeof(image_header);
@@ -607,7 +646,7 @@ uint32_t EspClass::getSketchSize() {
         ++section_index)
     {
         section_header_t section_header = {0, 0};
-        if (spi_flash_read(pos, (uint32_t*) &section_header, sizeof(section_header)) != SPI_FLASH_RESULT_OK) {
+        if (timed_spi_flash_read(pos, (uint32_t*) &section_header, sizeof(section_header)) != SPI_FLASH_RESULT_OK) {
             return 0;
         }
         pos += sizeof(section_header);
@@ -671,7 +710,7 @@ bool EspClass::updateSketch(Stream& in, uint32_t size, bool restartOnFail, bool
 static const int FLASH_INT_MASK = ((B10 << 8) | B00111010);
 
 bool EspClass::flashEraseSector(uint32_t sector) {
-    int rc = spi_flash_erase_sector(sector);
+    int rc = timed_spi_flash_erase_sector(sector);
     return rc == 0;
 }
 
@@ -690,18 +729,18 @@ static SpiFlashOpResult spi_flash_write_page_break(uint32_t offset, uint32_t *da
 
     // most common case, we don't cross a page and simply write the data
     if (size < size_page_aligned) {
-        return spi_flash_write(offset, data, size);
+        return timed_spi_flash_write(offset, data, size);
     }
 
     // otherwise, write the initial part and continue writing breaking each page interval
     SpiFlashOpResult result = SPI_FLASH_RESULT_ERR;
-    if ((result = spi_flash_write(offset, data, size_page_aligned)) != SPI_FLASH_RESULT_OK) {
+    if ((result = timed_spi_flash_write(offset, data, size_page_aligned)) != SPI_FLASH_RESULT_OK) {
         return result;
     }
 
     const auto last_page = (size - size_page_aligned) / PageSize;
     for (uint32_t page = 0; page < last_page; ++page) {
-        if ((result = spi_flash_write(offset + size_page_aligned, data + (size_page_aligned >> 2), PageSize)) != SPI_FLASH_RESULT_OK) {
+        if ((result = timed_spi_flash_write(offset + size_page_aligned, data + (size_page_aligned >> 2), PageSize)) != SPI_FLASH_RESULT_OK) {
             return result;
         }
 
@@ -709,7 +748,7 @@ static SpiFlashOpResult spi_flash_write_page_break(uint32_t offset, uint32_t *da
     }
 
     // finally, the remaining data
-    return spi_flash_write(offset + size_page_aligned, data + (size_page_aligned >> 2), size - size_page_aligned);
+    return timed_spi_flash_write(offset + size_page_aligned, data + (size_page_aligned >> 2), size - size_page_aligned);
 }
 
 #if PUYA_SUPPORT
@@ -746,7 +785,7 @@ static SpiFlashOpResult spi_flash_write_puya(uint32_t offset, uint32_t *data, si
         } else {
             bytesLeft = 0;
         }
-        rc = spi_flash_read(pos, flash_write_puya_buf, bytesNow);
+        rc = timed_spi_flash_read(pos, flash_write_puya_buf, bytesNow);
         if (rc != SPI_FLASH_RESULT_OK) {
             return rc;
         }
@@ -754,7 +793,7 @@ static SpiFlashOpResult spi_flash_write_puya(uint32_t offset, uint32_t *data, si
             flash_write_puya_buf[i] &= *ptr;
             ++ptr;
         }
-        rc = spi_flash_write(pos, flash_write_puya_buf, bytesNow);
+        rc = timed_spi_flash_write(pos, flash_write_puya_buf, bytesNow);
         pos += bytesNow;
     }
     return rc;
@@ -769,11 +808,6 @@ static T aligned(T value) {
     return (value + Mask) & ~Mask;
 }
 
-template <typename T>
-static T alignBefore(T value) {
-    return aligned(value) - Alignment;
-}
-
 static bool isAlignedAddress(uint32_t address) {
     return (address & (Alignment - 1)) == 0;
 }
@@ -788,63 +822,24 @@ static bool isAlignedPointer(const uint8_t *ptr) {
 
 
 size_t EspClass::flashWriteUnalignedMemory(uint32_t address, const uint8_t *data, size_t size) {
-    auto flash_write = [](uint32_t address, uint8_t *data, size_t size) {
-        return spi_flash_write(address, reinterpret_cast<uint32_t *>(data), size) == SPI_FLASH_RESULT_OK;
-    };
-
-    auto flash_read = [](uint32_t address, uint8_t *data, size_t size) {
-        return spi_flash_read(address, reinterpret_cast<uint32_t *>(data), size) == SPI_FLASH_RESULT_OK;
-    };
-
+    // Programming only clears bits, so padding the data with 0xff to whole
+    // words leaves the bytes around it as they are, and it needs no read.
+    // On PUYA chips flashWrite() does the read and &= itself.
     constexpr size_t BufferSize { FLASH_PAGE_SIZE };
     alignas(alignof(uint32_t)) uint8_t buf[BufferSize];
 
     size_t written = 0;
 
-    if (!isAlignedAddress(address)) {
-        auto before_address = alignBefore(address);
-        auto offset = address - before_address;
-        auto wlen = std::min(Alignment - offset, size);
-
-        if (!flash_read(before_address, &buf[0], Alignment)) {
-            return 0;
-        }
-
-#if PUYA_SUPPORT
-        if (getFlashChipVendorId() == SPI_FLASH_VENDOR_PUYA) {
-            for (size_t i = 0; i < wlen ; ++i) {
-                buf[offset + i] &= data[i];
-            }
-        } else {
-#endif
-            memcpy(&buf[offset], data, wlen);
-#if PUYA_SUPPORT
-        }
-#endif
-
-        if (!flash_write(before_address, &buf[0], Alignment)) {
-            return 0;
-        }
-
-        address += wlen;
-        data += wlen;
-        written += wlen;
-        size -= wlen;
-    }
-
     while (size > 0) {
-        auto len = std::min(size, BufferSize);
-        auto wlen = aligned(len);
-
-        if (wlen != len) {
-            auto partial = wlen - Alignment;
-            if (!flash_read(address + partial, &buf[partial], Alignment)) {
-                return written;
-            }
-        }
-
-        memcpy(&buf[0], data, len);
-        if (!flashWrite(address, reinterpret_cast<const uint32_t *>(&buf[0]), wlen)) {
+        const uint32_t start = address & ~(Alignment - 1);
+        const size_t offset = address - start;
+        // up to the end of the page, one program operation each
+        const size_t len = std::min(size, BufferSize - (start % BufferSize) - offset);
+        const size_t wlen = aligned(offset + len);
+
+        memset(&buf[0], 0xff, wlen);
+        memcpy(&buf[offset], data, len);
+        if (!flashWrite(start, reinterpret_cast<const uint32_t *>(&buf[0]), wlen)) {
             return written;
         }
 
@@ -916,7 +911,7 @@ bool EspClass::flashRead(uint32_t address, uint8_t *data, size_t size) {
 
     if (currentOffset < size) {
         uint32_t tempData;
-        if (spi_flash_read(address + currentOffset, &tempData, sizeof(tempData)) != SPI_FLASH_RESULT_OK) {
+        if (timed_spi_flash_read(address + currentOffset, &tempData, sizeof(tempData)) != SPI_FLASH_RESULT_OK) {
             return false;
         }
         memcpy(data + currentOffset, &tempData, size - currentOffset);
@@ -929,7 +924,7 @@ bool EspClass::flashRead(uint32_t address, uint32_t *data, size_t size) {
     if ((uintptr_t)data % 4 != 0 || size % 4 != 0) {
         return false;
     }
-    return (spi_flash_read(address, data, size) == SPI_FLASH_RESULT_OK);
+    return (timed_spi_flash_read(address, data, size) == SPI_FLASH_RESULT_OK);
 }
 
 String EspClass::getSketchMD5()
@@ -122,6 +122,9 @@ class EspClass {
 #endif
         static uint32_t getFreeContStack();
         static void resetFreeContStack();
+        // BearSSL stack: current size (0 when not allocated), usage of the
+        // current one and peak usage since boot
+        static void getStackThunkStats(uint32_t* size = nullptr, uint32_t* used = nullptr, uint32_t* peak = nullptr);
 
         static const char * getSdkVersion();
         static String getCoreVersion();
@@ -176,7 +179,7 @@ class EspClass {
          * This overload handles all misalignment cases
          * @param address address on flash where write should start
          * @param data input buffer, passing unaligned memory will cause significant stack usage
-         * @param size amount of data, passing not multiple of 4 will cause additional reads and writes
+         * @param size amount of data, not multiple of 4 is padded with 0xff, which leaves flash as it is
          * @return bool result of operation
          */
         static bool flashWrite(uint32_t address, const uint8_t *data, size_t size);
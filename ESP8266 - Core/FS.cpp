@@ -36,7 +36,10 @@ size_t File::Write(const uint8_t *buf, size_t Size) {
     if (!_p)
         return 0;
 
-    return _p->Write(buf, Size);
+    size_t written = _p->Write(buf, Size);
+    if (_p->GetWriteError())
+        SetWriteError();
+    return written;
 }
 
 int File::Available() {
@@ -73,10 +76,41 @@ int File::Read(uint8_t* buf, size_t Size) {
     return _p->Read(buf, Size);
 }
 
+bool File::HasPeekBufferAPI() const {
+    if (!_p)
+        return false;
+
+    return _p->HasPeekBufferAPI();
+}
+
+size_t File::PeekAvailable() {
+    if (!_p)
+        return 0;
+
+    return _p->PeekAvailable();
+}
+
+const char* File::PeekBuffer() {
+    if (!_p)
+        return nullptr;
+
+    return _p->PeekBuffer();
+}
+
+void File::PeekConsume(size_t consume) {
+    if (!_p)
+        return;
+
+    _p->PeekConsume(consume);
+}
+
 int File::Peek() {
     if (!_p)
         return -1;
 
+    if (_p->HasPeekBufferAPI() && _p->PeekAvailable())
+        return (uint8_t)*_p->PeekBuffer();
+
     size_t curPos = _p->Position();
     int result = Read();
     Seek(curPos, SeekSet);
@@ -88,6 +122,8 @@ void File::Flush() {
         return;
 
     _p->Flush();
+    if (_p->GetWriteError())
+        SetWriteError();
 }
 
 bool File::Seek(uint32_t pos, SeekMode mode) {
@@ -114,6 +150,8 @@ size_t File::Size() const {
 void File::Close() {
     if (_p) {
         _p->Close();
+        if (_p->GetWriteError())
+            SetWriteError();
         _p = nullptr;
     }
 }
@@ -129,6 +167,30 @@ bool File::Truncate(uint32_t Size) {
     return _p->Truncate(Size);
 }
 
+bool File::GetSpan(size_t pos, FileSpan& span) {
+    if (!_p)
+        return false;
+
+    uint32_t address;
+    size_t length;
+    if (!_p->GetSpan(pos, address, length))
+        return false;
+
+    span.address = address;
+    span.length = length;
+    // the flash cache maps the first megabyte of flash at 0x40200000
+    span.data = (address + length <= 0x100000) ? (const uint8_t*)(0x40200000 + address) : nullptr;
+    return true;
+}
+
+const uint8_t* File::Mmap() {
+    FileSpan span;
+    if (!GetSpan(0, span) || span.length != Size())
+        return nullptr;
+
+    return span.data;
+}
+
 const char* File::Name() const {
     if (!_p)
         return nullptr;
@@ -49,6 +49,13 @@ enum SeekMode {
     SeekEnd = 2
 };
 
+// A run of File data stored contiguously in flash, see File::GetSpan()
+struct FileSpan {
+    uint32_t       address;  // physical flash address
+    size_t         length;   // File bytes stored from address on
+    const uint8_t* data;     // same bytes through the flash cache, nullptr when not mapped
+};
+
 class File : public Stream
 {
 public:
@@ -81,30 +88,21 @@ public:
     const char* FullName() const; // Includes path
     bool Truncate(uint32_t size);
 
+    // Read-only access to the data where it is stored, without copies.
+    // GetSpan() gives the run holding pos; Mmap() the whole File when it is
+    // one run inside the mapped flash, nullptr otherwise. Both stay valid
+    // until the filesystem is written to. data points into flash: read it
+    // with pgm_read_*(), memcpy_P() or StreamConstPtr.
+    bool GetSpan(size_t pos, FileSpan& span);
+    const uint8_t* Mmap();
+
     bool IsFile() const;
     bool IsDirectory() const;
 
     // Arduino "class SD" methods for compatibility
-    //TODO use stream::send / check read(buf,size) result
     template<typename T> size_t Write(T &src){
-      uint8_t obuf[256];
-      size_t doneLen = 0;
-      size_t sentLen;
-
-      while (src.Available() > (int)sizeof(obuf)){
-        src.read(obuf, sizeof(obuf));
-        sentLen = Write(obuf, sizeof(obuf));
-        doneLen = doneLen + sentLen;
-        if(sentLen != sizeof(obuf)){
-          return doneLen;
-        }
-      }
-
-      size_t leftLen = src.Available();
-      src.Read(obuf, leftLen);
-      sentLen = Write(obuf, leftLen);
-      doneLen = doneLen + sentLen;
-      return doneLen;
+      // straight from src's peek buffer when it has one
+      return src.SendAvailable(this);
     }
     using PrintClass::Write;
 
@@ -113,6 +111,12 @@ public:
 
     String ReadString() override;
 
+    // Stream peek buffer API, when the underlying File implements it
+    bool HasPeekBufferAPI () const override;
+    size_t PeekAvailable () override;
+    const char* PeekBuffer () override;
+    void PeekConsume (size_t consume) override;
+
     time_t GetLastWrite();
     time_t GetCreationTime();
     void SetTimeCallBack(time_t (*cb)(void));
@@ -273,6 +277,7 @@ void spiffs_request_end(void);
 using fs::FS;
 using fs::File;
 using fs::Dir;
+using fs::FileSpan;
 using fs::SeekMode;
 using fs::SeekSet;
 using fs::SeekCur;
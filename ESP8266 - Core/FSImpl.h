@@ -36,6 +36,19 @@ public:
     virtual size_t Position() const = 0;
     virtual size_t Size() const = 0;
     virtual int AvailableForWrite() { return 0; }
+    // true once written data failed to reach the storage, e.g. on Flush()
+    virtual bool GetWriteError() const { return false; }
+
+    // Optional read buffer, see Stream::PeekBuffer(). Read(), Seek() and
+    // Position() must stay consistent with it.
+    virtual bool HasPeekBufferAPI() const { return false; }
+    virtual size_t PeekAvailable() { return 0; }
+    virtual const char* PeekBuffer() { return nullptr; }
+    virtual void PeekConsume(size_t consume) { (void)consume; }
+
+    // Physical flash address of the data at pos, and how many bytes of
+    // the File are stored contiguously from there
+    virtual bool GetSpan(size_t pos, uint32_t& address, size_t& length) { (void)pos; (void)address; (void)length; return false; }
     virtual bool Truncate(uint32_t size) = 0;
     virtual void Close() = 0;
     virtual const char* Name() const = 0;
@@ -50,6 +50,9 @@
 #include "user_interface.h"
 #include "mem.h"
 
+#include "lwip/timeouts.h"
+
+#include <algorithm>
 #include <cstring>
 #include <sys/pgmspace.h>
 
@@ -95,15 +98,6 @@ typedef enum
     DHCPS_STATE_OFFLINE
 } dhcps_state_t;
 
-struct dhcps_pool
-{
-    struct ipv4_addr ip;
-    uint8            mac[6];
-    uint32           lease_timer;
-    dhcps_type_t     type;
-    dhcps_state_t    state;
-};
-
 #define DHCPS_MAX_LEASE 0x64
 #define BOOTP_BROADCAST 0x8000
 
@@ -193,94 +187,246 @@ DhcpServer::OptionsBuffer& DhcpServer::OptionsBuffer::add(uint8_t code, const ui
 
 ////////////////////////////////////////////////////////////////////////////////////
 
-DhcpServer::DhcpServer(netif* netif) : _netif(netif) { }
+DhcpServer::DhcpServer(netif* netif) : _netif(netif)
+{
+    lease_reset();
+}
 
 // wifi_softap_set_station_info is missing in user_interface.h:
 extern "C" void wifi_softap_set_station_info(uint8_t* mac, struct ipv4_addr*);
 
+#define DHCPS_COARSE_TMR_MS (60 * 1000)  // lease_time unit
+
 /******************************************************************************
-    FunctionName : node_insert_to_list
-    Description  : insert the node to the list
-    Parameters   : arg -- Additional argument to pass to the callback function
-    Returns      : none
+    FunctionName : lease_reset
+    Description  : forget all leases
 *******************************************************************************/
-void DhcpServer::node_insert_to_list(list_node** phead, list_node* pinsert)
+void DhcpServer::lease_reset()
 {
-    list_node*         plist       = nullptr;
-    struct dhcps_pool* pdhcps_pool = nullptr;
-    struct dhcps_pool* pdhcps_node = nullptr;
-    if (*phead == nullptr)
+    static_assert(LeasePoolSize == DHCPS_MAX_LEASE + 1, "lease pool must cover DHCPS_MAX_LEASE");
+    static_assert(LeaseHashSize > LeasePoolSize, "lease hash must have free slots");
+
+    memset(leaseByMac, NoLease, sizeof(leaseByMac));
+    memset(leaseUsed, 0, sizeof(leaseUsed));
+    leaseHeapLen = 0;
+    leaseCount   = 0;
+    leaseClock   = 0;
+}
+
+int DhcpServer::lease_pool_size() const
+{
+    uint32 start_ip = ntohl(lease.start_ip.addr);
+    uint32 end_ip   = ntohl(lease.end_ip.addr);
+    if (start_ip > end_ip)
     {
-        *phead = pinsert;
+        return 0;
     }
-    else
+    return std::min<uint32>(end_ip - start_ip + 1, LeasePoolSize);
+}
+
+int DhcpServer::lease_offset(uint32 ip) const
+{
+    uint32 offset = ntohl(ip) - ntohl(lease.start_ip.addr);
+    return (offset < (uint32)lease_pool_size()) ? (int)offset : -1;
+}
+
+uint32 DhcpServer::lease_ip(int offset) const
+{
+    return htonl(ntohl(lease.start_ip.addr) + offset);
+}
+
+bool DhcpServer::is_lease_used(int offset) const
+{
+    return leaseUsed[offset / 32] & (1u << (offset % 32));
+}
+
+unsigned DhcpServer::lease_hash(const uint8* mac) const
+{
+    // FNV-1a, NIC specific bytes last so they spread the most
+    uint32 h = 2166136261u;
+    for (int i = 0; i < 6; i++)
     {
-        plist       = *phead;
-        pdhcps_node = (struct dhcps_pool*)pinsert->pnode;
-        pdhcps_pool = (struct dhcps_pool*)plist->pnode;
+        h = (h ^ mac[i]) * 16777619u;
+    }
+    return h & (LeaseHashSize - 1);
+}
 
-        if (pdhcps_node->ip.addr < pdhcps_pool->ip.addr)
+/******************************************************************************
+    FunctionName : lease_find
+    Description  : look up the lease of a MAC address
+    Returns      : offset of the lease in the pool, -1 if none
+*******************************************************************************/
+int DhcpServer::lease_find(const uint8* mac) const
+{
+    for (unsigned slot = lease_hash(mac);; slot = (slot + 1) & (LeaseHashSize - 1))
+    {
+        uint8_t offset = leaseByMac[slot];
+        if (offset == NoLease)
         {
-            pinsert->pnext = plist;
-            *phead         = pinsert;
+            return -1;
         }
-        else
+        if (memcmp(leases[offset].mac, mac, sizeof(leases[offset].mac)) == 0)
         {
-            while (plist->pnext != nullptr)
-            {
-                pdhcps_pool = (struct dhcps_pool*)plist->pnext->pnode;
-                if (pdhcps_node->ip.addr < pdhcps_pool->ip.addr)
-                {
-                    pinsert->pnext = plist->pnext;
-                    plist->pnext   = pinsert;
-                    break;
-                }
-                plist = plist->pnext;
-            }
+            return offset;
+        }
+    }
+}
 
-            if (plist->pnext == nullptr)
-            {
-                plist->pnext = pinsert;
-            }
+/******************************************************************************
+    FunctionName : lease_free_offset
+    Description  : lowest address of the pool not leased
+    Returns      : offset in the pool, -1 if all are in use
+*******************************************************************************/
+int DhcpServer::lease_free_offset() const
+{
+    const int size = lease_pool_size();
+    for (int w = 0; w * 32 < size; w++)
+    {
+        uint32_t free_bits = ~leaseUsed[w];
+        if (free_bits)
+        {
+            int offset = w * 32 + __builtin_ctz(free_bits);
+            return (offset < size) ? offset : -1;
+        }
+    }
+    return -1;
+}
+
+void DhcpServer::lease_insert(int offset, const uint8* mac)
+{
+    Lease& l  = leases[offset];
+    l.heapPos = NoLease;
+    memcpy(l.mac, mac, sizeof(l.mac));
+    leaseUsed[offset / 32] |= 1u << (offset % 32);
+    leaseCount++;
+
+    unsigned slot = lease_hash(mac);
+    while (leaseByMac[slot] != NoLease)
+    {
+        slot = (slot + 1) & (LeaseHashSize - 1);
+    }
+    leaseByMac[slot] = offset;
+}
+
+void DhcpServer::lease_hash_remove(int offset)
+{
+    unsigned slot = lease_hash(leases[offset].mac);
+    while (leaseByMac[slot] != offset)
+    {
+        slot = (slot + 1) & (LeaseHashSize - 1);
+    }
+
+    // backward shift deletion, keeps probe chains intact without tombstones
+    leaseByMac[slot] = NoLease;
+    for (unsigned next = (slot + 1) & (LeaseHashSize - 1); leaseByMac[next] != NoLease;
+         next          = (next + 1) & (LeaseHashSize - 1))
+    {
+        unsigned home = lease_hash(leases[leaseByMac[next]].mac);
+        // move the entry if its home slot is not within (slot, next]
+        if (((next - home) & (LeaseHashSize - 1)) >= ((next - slot) & (LeaseHashSize - 1)))
+        {
+            leaseByMac[slot] = leaseByMac[next];
+            leaseByMac[next] = NoLease;
+            slot             = next;
         }
     }
-    //  pinsert->pnext = nullptr;
+}
+
+void DhcpServer::lease_delete(int offset)
+{
+    if (leases[offset].heapPos != NoLease)
+    {
+        lease_heap_remove(offset);
+    }
+    lease_hash_remove(offset);
+    leaseUsed[offset / 32] &= ~(1u << (offset % 32));
+    leaseCount--;
+}
+
+void DhcpServer::lease_set_mac(int offset, const uint8* mac)
+{
+    uint8_t heapPos = leases[offset].heapPos;
+    lease_hash_remove(offset);
+    leaseUsed[offset / 32] &= ~(1u << (offset % 32));
+    leaseCount--;
+    lease_insert(offset, mac);
+    leases[offset].heapPos = heapPos;
 }
 
 /******************************************************************************
-    FunctionName : node_delete_from_list
-    Description  : remove the node from list
-    Parameters   : arg -- Additional argument to pass to the callback function
-    Returns      : none
+    FunctionName : lease_start
+    Description  : (re)start the lease timer, dynamic leases go to the expiry heap
 *******************************************************************************/
-void DhcpServer::node_remove_from_list(list_node** phead, list_node* pdelete)
+void DhcpServer::lease_start(int offset, uint8 type)
 {
-    list_node* plist = nullptr;
+    Lease& l  = leases[offset];
+    l.type    = type;
+    l.state   = DHCPS_STATE_ONLINE;
+    l.expires = leaseClock + lease_time;
+    if (l.heapPos != NoLease)
+    {
+        lease_heap_remove(offset);
+    }
+    if (type == DHCPS_TYPE_DYNAMIC)
+    {
+        lease_heap_push(offset);
+    }
+}
 
-    plist = *phead;
-    if (plist == nullptr)
+void DhcpServer::lease_heap_swap(int a, int b)
+{
+    std::swap(leaseHeap[a], leaseHeap[b]);
+    leases[leaseHeap[a]].heapPos = a;
+    leases[leaseHeap[b]].heapPos = b;
+}
+
+void DhcpServer::lease_heap_sift(int pos)
+{
+    auto earlier = [this](int a, int b)
+    { return (int32_t)(leases[leaseHeap[a]].expires - leases[leaseHeap[b]].expires) < 0; };
+
+    while (pos > 0 && earlier(pos, (pos - 1) / 2))
     {
-        *phead = nullptr;
+        lease_heap_swap(pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
     }
-    else
+    while (true)
     {
-        if (plist == pdelete)
+        int child = 2 * pos + 1;
+        if (child >= leaseHeapLen)
+        {
+            break;
+        }
+        if (child + 1 < leaseHeapLen && earlier(child + 1, child))
         {
-            *phead         = plist->pnext;
-            pdelete->pnext = nullptr;
+            child++;
         }
-        else
+        if (!earlier(child, pos))
         {
-            while (plist != nullptr)
-            {
-                if (plist->pnext == pdelete)
-                {
-                    plist->pnext   = pdelete->pnext;
-                    pdelete->pnext = nullptr;
-                }
-                plist = plist->pnext;
-            }
+            break;
         }
+        lease_heap_swap(pos, child);
+        pos = child;
+    }
+}
+
+void DhcpServer::lease_heap_push(int offset)
+{
+    int pos                 = leaseHeapLen++;
+    leaseHeap[pos]          = offset;
+    leases[offset].heapPos  = pos;
+    lease_heap_sift(pos);
+}
+
+void DhcpServer::lease_heap_remove(int offset)
+{
+    int pos                = leases[offset].heapPos;
+    leases[offset].heapPos = NoLease;
+    if (pos != --leaseHeapLen)
+    {
+        leaseHeap[pos]                  = leaseHeap[leaseHeapLen];
+        leases[leaseHeap[pos]].heapPos  = pos;
+        lease_heap_sift(pos);
     }
 }
 
@@ -292,29 +438,16 @@ void DhcpServer::node_remove_from_list(list_node** phead, list_node* pdelete)
 *******************************************************************************/
 bool DhcpServer::add_dhcps_lease(uint8* macaddr)
 {
-    struct dhcps_pool* pdhcps_pool = nullptr;
-    list_node*         pback_node  = nullptr;
-
-    uint32 start_ip = lease.start_ip.addr;
-    uint32 end_ip   = lease.end_ip.addr;
-
-    for (pback_node = plist; pback_node != nullptr; pback_node = pback_node->pnext)
+    if (lease_find(macaddr) >= 0)
     {
-        pdhcps_pool = (dhcps_pool*)pback_node->pnode;
-        if (memcmp(pdhcps_pool->mac, macaddr, sizeof(pdhcps_pool->mac)) == 0)
-        {
 #if DHCPS_DEBUG
-            os_printf("this mac already exist");
+        os_printf("this mac already exist");
 #endif
-            return false;
-        }
-        else
-        {
-            start_ip = htonl((ntohl(start_ip) + 1));
-        }
+        return false;
     }
 
-    if (start_ip > end_ip)
+    int offset = lease_free_offset();
+    if (offset < 0)
     {
 #if DHCPS_DEBUG
         os_printf("no more ip available");
@@ -322,16 +455,8 @@ bool DhcpServer::add_dhcps_lease(uint8* macaddr)
         return false;
     }
 
-    pdhcps_pool          = (struct dhcps_pool*)zalloc(sizeof(struct dhcps_pool));
-    pdhcps_pool->ip.addr = start_ip;
-    memcpy(pdhcps_pool->mac, macaddr, sizeof(pdhcps_pool->mac));
-    pdhcps_pool->lease_timer = this->lease_time;
-    pdhcps_pool->type        = DHCPS_TYPE_STATIC;
-    pdhcps_pool->state       = DHCPS_STATE_ONLINE;
-    pback_node               = (list_node*)zalloc(sizeof(list_node));
-    pback_node->pnode        = pdhcps_pool;
-    pback_node->pnext        = nullptr;
-    node_insert_to_list(&plist, pback_node);
+    lease_insert(offset, macaddr);
+    lease_start(offset, DHCPS_TYPE_STATIC);
 
     return true;
 }
@@ -890,7 +1015,15 @@ bool DhcpServer::Begin()
     // XXXFIXMEIPV6 broadcast address?
 
     server_address = *ip_2_ip4(&_netif->ip_addr);
+    const dhcps_lease prev = lease;
     init_dhcps_lease(server_address.addr);
+    if (lease.start_ip.addr != prev.start_ip.addr || lease.end_ip.addr != prev.end_ip.addr)
+    {
+        // leases are indexed by their offset in the pool, they don't survive a new range
+        lease_drop_all();
+    }
+    sys_untimeout(S_dhcps_coarse_tmr, this);
+    sys_timeout(DHCPS_COARSE_TMR_MS, S_dhcps_coarse_tmr, this);
 
     udp_bind(pcb_dhcps, IP_ADDR_ANY, DHCPS_SERVER_PORT);
     udp_recv(pcb_dhcps, S_handle_dhcp, this);
@@ -918,30 +1051,27 @@ void DhcpServer::end()
     udp_remove(pcb_dhcps);
     pcb_dhcps = nullptr;
 
-    // udp_remove(pcb_dhcps);
-    list_node*         pnode      = nullptr;
-    list_node*         pback_node = nullptr;
-    struct dhcps_pool* dhcp_node  = nullptr;
-    struct ipv4_addr   ip_zero;
+    sys_untimeout(S_dhcps_coarse_tmr, this);
 
+    lease_drop_all();
+}
+
+/******************************************************************************
+    FunctionName : lease_drop_all
+    Description  : forget all leases, and their addresses in the softap
+*******************************************************************************/
+void DhcpServer::lease_drop_all()
+{
+    struct ipv4_addr ip_zero;
     memset(&ip_zero, 0x0, sizeof(ip_zero));
-    pnode = plist;
-    while (pnode != nullptr)
-    {
-        pback_node = pnode;
-        pnode      = pback_node->pnext;
-        node_remove_from_list(&plist, pback_node);
-        dhcp_node = (struct dhcps_pool*)pback_node->pnode;
-        // dhcps_client_leave(dhcp_node->mac,&dhcp_node->ip,true); // force to delete
-        if (_netif->num == SOFTAP_IF)
+    for (int offset = 0; offset < LeasePoolSize; offset++)
+    {
+        if (is_lease_used(offset) && _netif->num == SOFTAP_IF)
         {
-            wifi_softap_set_station_info(dhcp_node->mac, &ip_zero);
+            wifi_softap_set_station_info(leases[offset].mac, &ip_zero);
         }
-        free(pback_node->pnode);
-        pback_node->pnode = nullptr;
-        free(pback_node);
-        pback_node = nullptr;
     }
+    lease_reset();
 }
 
 bool DhcpServer::isRunning() const
@@ -1065,65 +1195,29 @@ bool DhcpServer::get_dhcps_lease(struct dhcps_lease* please)
 
 void DhcpServer::kill_oldest_dhcps_pool(void)
 {
-    list_node *        pre = nullptr, *p = nullptr;
-    list_node *        minpre = nullptr, *minp = nullptr;
-    struct dhcps_pool *pdhcps_pool = nullptr, *pmin_pool = nullptr;
-    pre    = plist;
-    p      = pre->pnext;
-    minpre = pre;
-    minp   = p;
-    while (p != nullptr)
-    {
-        pdhcps_pool = (struct dhcps_pool*)p->pnode;
-        pmin_pool   = (struct dhcps_pool*)minp->pnode;
-        if (pdhcps_pool->lease_timer < pmin_pool->lease_timer)
-        {
-            minp   = p;
-            minpre = pre;
-        }
-        pre = p;
-        p   = p->pnext;
-    }
-    minpre->pnext      = minp->pnext;
-    pdhcps_pool->state = DHCPS_STATE_OFFLINE;
-    free(minp->pnode);
-    minp->pnode = nullptr;
-    free(minp);
-    minp = nullptr;
+    // dynamic lease closest to expiry
+    if (leaseHeapLen)
+    {
+        lease_delete(leaseHeap[0]);
+    }
+}
+
+void DhcpServer::S_dhcps_coarse_tmr(void* arg)
+{
+    DhcpServer* instance = reinterpret_cast<DhcpServer*>(arg);
+    instance->dhcps_coarse_tmr();
+    sys_timeout(DHCPS_COARSE_TMR_MS, S_dhcps_coarse_tmr, instance);
 }
 
 void DhcpServer::dhcps_coarse_tmr(void)
 {
-    uint8              num_dhcps_pool = 0;
-    list_node*         pback_node     = nullptr;
-    list_node*         pnode          = nullptr;
-    struct dhcps_pool* pdhcps_pool    = nullptr;
-    pnode                             = plist;
-    while (pnode != nullptr)
-    {
-        pdhcps_pool = (struct dhcps_pool*)pnode->pnode;
-        if (pdhcps_pool->type == DHCPS_TYPE_DYNAMIC)
-        {
-            pdhcps_pool->lease_timer--;
-        }
-        if (pdhcps_pool->lease_timer == 0)
-        {
-            pback_node = pnode;
-            pnode      = pback_node->pnext;
-            node_remove_from_list(&plist, pback_node);
-            free(pback_node->pnode);
-            pback_node->pnode = nullptr;
-            free(pback_node);
-            pback_node = nullptr;
-        }
-        else
-        {
-            pnode = pnode->pnext;
-            num_dhcps_pool++;
-        }
+    leaseClock++;
+    while (leaseHeapLen && (int32_t)(leases[leaseHeap[0]].expires - leaseClock) <= 0)
+    {
+        lease_delete(leaseHeap[0]);
     }
 
-    if (num_dhcps_pool >= MAX_STATION_NUM)
+    if (leaseCount >= MAX_STATION_NUM)
     {
         kill_oldest_dhcps_pool();
     }
@@ -1131,63 +1225,37 @@ void DhcpServer::dhcps_coarse_tmr(void)
 
 void DhcpServer::dhcps_client_leave(u8* bssid, struct ipv4_addr* ip, bool force)
 {
-    struct dhcps_pool* pdhcps_pool = nullptr;
-    list_node*         pback_node  = nullptr;
-
     if ((bssid == nullptr) || (ip == nullptr))
     {
         return;
     }
 
-    for (pback_node = plist; pback_node != nullptr; pback_node = pback_node->pnext)
+    int offset = lease_find(bssid);
+    if (offset < 0 || lease_ip(offset) != ip->addr)
     {
-        pdhcps_pool = (struct dhcps_pool*)pback_node->pnode;
-        if (memcmp(pdhcps_pool->mac, bssid, sizeof(pdhcps_pool->mac)) == 0)
-        {
-            if (memcmp(&pdhcps_pool->ip.addr, &ip->addr, sizeof(pdhcps_pool->ip.addr)) == 0)
-            {
-                if ((pdhcps_pool->type == DHCPS_TYPE_STATIC) || (force))
-                {
-                    if (pback_node != nullptr)
-                    {
-                        node_remove_from_list(&plist, pback_node);
-                        free(pback_node);
-                        pback_node = nullptr;
-                    }
-
-                    if (pdhcps_pool != nullptr)
-                    {
-                        free(pdhcps_pool);
-                        pdhcps_pool = nullptr;
-                    }
-                }
-                else
-                {
-                    pdhcps_pool->state = DHCPS_STATE_OFFLINE;
-                }
-
-                struct ipv4_addr ip_zero;
-                memset(&ip_zero, 0x0, sizeof(ip_zero));
-                if (_netif->num == SOFTAP_IF)
-                {
-                    wifi_softap_set_station_info(bssid, &ip_zero);
-                }
-                break;
-            }
-        }
+        return;
+    }
+
+    if ((leases[offset].type == DHCPS_TYPE_STATIC) || (force))
+    {
+        lease_delete(offset);
+    }
+    else
+    {
+        leases[offset].state = DHCPS_STATE_OFFLINE;
+    }
+
+    struct ipv4_addr ip_zero;
+    memset(&ip_zero, 0x0, sizeof(ip_zero));
+    if (_netif->num == SOFTAP_IF)
+    {
+        wifi_softap_set_station_info(bssid, &ip_zero);
     }
 }
 
 uint32 DhcpServer::dhcps_client_update(u8* bssid, struct ipv4_addr* ip)
 {
-    struct dhcps_pool* pdhcps_pool = nullptr;
-    list_node*         pback_node  = nullptr;
-    list_node*         pmac_node   = nullptr;
-    list_node*         pip_node    = nullptr;
-    bool               flag        = false;
-    uint32             start_ip    = lease.start_ip.addr;
-    uint32             end_ip      = lease.end_ip.addr;
-    dhcps_type_t       type        = DHCPS_TYPE_DYNAMIC;
+    dhcps_type_t type = DHCPS_TYPE_DYNAMIC;
     if (bssid == nullptr)
     {
         return IPADDR_ANY;
@@ -1209,163 +1277,59 @@ uint32 DhcpServer::dhcps_client_update(u8* bssid, struct ipv4_addr* ip)
         }
     }
 
-    renew = false;
-    for (pback_node = plist; pback_node != nullptr; pback_node = pback_node->pnext)
+    renew          = false;
+    int mac_offset = lease_find(bssid);
+
+    if (ip == nullptr)
     {
-        pdhcps_pool = (struct dhcps_pool*)pback_node->pnode;
-        // os_printf("mac:"MACSTR"bssid:"MACSTR"\r\n",MAC2STR(pdhcps_pool->mac),MAC2STR(bssid));
-        if (memcmp(pdhcps_pool->mac, bssid, sizeof(pdhcps_pool->mac)) == 0)
+        // known station keeps its address, new one gets the lowest free one
+        if (mac_offset < 0)
         {
-            pmac_node = pback_node;
-            if (ip == nullptr)
-            {
-                flag = true;
-                break;
-            }
-        }
-        if (ip != nullptr)
-        {
-            if (memcmp(&pdhcps_pool->ip.addr, &ip->addr, sizeof(pdhcps_pool->ip.addr)) == 0)
-            {
-                pip_node = pback_node;
-            }
-        }
-        else if (flag == false)
-        {
-            if (memcmp(&pdhcps_pool->ip.addr, &start_ip, sizeof(pdhcps_pool->ip.addr)) != 0)
-            {
-                flag = true;
-            }
-            else
+            mac_offset = lease_free_offset();
+            if (mac_offset < 0)  // no ip to distribute
             {
-                start_ip = htonl((ntohl(start_ip) + 1));
+                return IPADDR_ANY;
             }
+            lease_insert(mac_offset, bssid);
         }
+        lease_start(mac_offset, type);
+        return lease_ip(mac_offset);
     }
 
-    if ((ip == nullptr) && (flag == false))
+    int ip_offset = lease_offset(ip->addr);
+    if (ip_offset < 0)  // not from our pool
     {
-        if (plist == nullptr)
-        {
-            if (start_ip <= end_ip)
-            {
-                flag = true;
-            }
-            else
-            {
-                return IPADDR_ANY;
-            }
-        }
-        else
-        {
-            if (start_ip > end_ip)
-            {
-                return IPADDR_ANY;
-            }
-            // start_ip = htonl((ntohl(start_ip) + 1));
-            flag = true;
-        }
+        return IPADDR_ANY;
     }
 
-    if (pmac_node != nullptr)  // update new ip
+    if (mac_offset == ip_offset)
     {
-        if (pip_node != nullptr)
+        renew = true;
+        type  = DHCPS_TYPE_DYNAMIC;
+    }
+    else if (is_lease_used(ip_offset))
+    {
+        if (leases[ip_offset].state != DHCPS_STATE_OFFLINE)  // ip is used
         {
-            pdhcps_pool = (struct dhcps_pool*)pip_node->pnode;
-
-            if (pip_node != pmac_node)
-            {
-                if (pdhcps_pool->state != DHCPS_STATE_OFFLINE)  // ip is used
-                {
-                    return IPADDR_ANY;
-                }
-
-                // mac exists and ip exists in other node,delete mac
-                node_remove_from_list(&plist, pmac_node);
-                free(pmac_node->pnode);
-                pmac_node->pnode = nullptr;
-                free(pmac_node);
-                pmac_node = pip_node;
-                memcpy(pdhcps_pool->mac, bssid, sizeof(pdhcps_pool->mac));
-            }
-            else
-            {
-                renew = true;
-                type  = DHCPS_TYPE_DYNAMIC;
-            }
-
-            pdhcps_pool->lease_timer = this->lease_time;
-            pdhcps_pool->type        = type;
-            pdhcps_pool->state       = DHCPS_STATE_ONLINE;
+            return IPADDR_ANY;
         }
-        else
+        // ip was left by another station, drop this mac's old lease and take it over
+        if (mac_offset >= 0)
         {
-            pdhcps_pool = (struct dhcps_pool*)pmac_node->pnode;
-            if (ip != nullptr)
-            {
-                pdhcps_pool->ip.addr = ip->addr;
-            }
-            else if (flag == true)
-            {
-                pdhcps_pool->ip.addr = start_ip;
-            }
-            else  // no ip to distribute
-            {
-                return IPADDR_ANY;
-            }
-
-            node_remove_from_list(&plist, pmac_node);
-            pdhcps_pool->lease_timer = this->lease_time;
-            pdhcps_pool->type        = type;
-            pdhcps_pool->state       = DHCPS_STATE_ONLINE;
-            node_insert_to_list(&plist, pmac_node);
+            lease_delete(mac_offset);
         }
+        lease_set_mac(ip_offset, bssid);
     }
-    else  // new station
+    else
     {
-        if (pip_node != nullptr)  // maybe ip has used
-        {
-            pdhcps_pool = (struct dhcps_pool*)pip_node->pnode;
-            if (pdhcps_pool->state != DHCPS_STATE_OFFLINE)
-            {
-                return IPADDR_ANY;
-            }
-            memcpy(pdhcps_pool->mac, bssid, sizeof(pdhcps_pool->mac));
-            pdhcps_pool->lease_timer = this->lease_time;
-            pdhcps_pool->type        = type;
-            pdhcps_pool->state       = DHCPS_STATE_ONLINE;
-        }
-        else
+        // move to the requested ip
+        if (mac_offset >= 0)
         {
-            pdhcps_pool = (struct dhcps_pool*)zalloc(sizeof(struct dhcps_pool));
-            if (ip != nullptr)
-            {
-                pdhcps_pool->ip.addr = ip->addr;
-            }
-            else if (flag == true)
-            {
-                pdhcps_pool->ip.addr = start_ip;
-            }
-            else  // no ip to distribute
-            {
-                free(pdhcps_pool);
-                return IPADDR_ANY;
-            }
-            if (pdhcps_pool->ip.addr > end_ip)
-            {
-                free(pdhcps_pool);
-                return IPADDR_ANY;
-            }
-            memcpy(pdhcps_pool->mac, bssid, sizeof(pdhcps_pool->mac));
-            pdhcps_pool->lease_timer = this->lease_time;
-            pdhcps_pool->type        = type;
-            pdhcps_pool->state       = DHCPS_STATE_ONLINE;
-            pback_node               = (list_node*)zalloc(sizeof(list_node));
-            pback_node->pnode        = pdhcps_pool;
-            pback_node->pnext        = nullptr;
-            node_insert_to_list(&plist, pback_node);
+            lease_delete(mac_offset);
         }
+        lease_insert(ip_offset, bssid);
     }
 
-    return pdhcps_pool->ip.addr;
+    lease_start(ip_offset, type);
+    return ip->addr;
 }
@@ -189,14 +189,43 @@ protected:
 
     // legacy C structure and API to eventually turn into C++
 
-    typedef struct _list_node
+    // Lease table, preallocated (no allocation per lease):
+    // - records are indexed by the offset of their address in the pool,
+    // - an open-addressed hash maps client MAC to record,
+    // - a bitmap tracks addresses in use,
+    // - a min-heap orders dynamic leases by expiry for dhcps_coarse_tmr().
+    static constexpr int     LeasePoolSize = 101;  // DHCPS_MAX_LEASE + 1
+    static constexpr int     LeaseHashSize = 128;  // power of 2, > LeasePoolSize
+    static constexpr uint8_t NoLease       = 0xff;
+
+    struct Lease
     {
-        void*              pnode;
-        struct _list_node* pnext;
-    } list_node;
+        uint8   mac[6];
+        uint8   type;     // dhcps_type_t
+        uint8   state;    // dhcps_state_t
+        uint8   heapPos;  // NoLease if not in the expiry heap
+        uint32  expires;  // leaseClock value
+    };
 
-    void node_insert_to_list(list_node** phead, list_node* pinsert);
-    void node_remove_from_list(list_node** phead, list_node* pdelete);
+    void     lease_reset();
+    void     lease_drop_all();
+    int      lease_pool_size() const;
+    int      lease_offset(uint32 ip) const;
+    uint32   lease_ip(int offset) const;
+    bool     is_lease_used(int offset) const;
+    int      lease_find(const uint8* mac) const;
+    int      lease_free_offset() const;
+    void     lease_insert(int offset, const uint8* mac);
+    void     lease_delete(int offset);
+    void     lease_set_mac(int offset, const uint8* mac);
+    void     lease_start(int offset, uint8 type);
+    unsigned lease_hash(const uint8* mac) const;
+    void     lease_hash_remove(int offset);
+    void     lease_heap_push(int offset);
+    void     lease_heap_remove(int offset);
+    void     lease_heap_swap(int a, int b);
+    void     lease_heap_sift(int pos);
+    static void S_dhcps_coarse_tmr(void* arg);
 
     OptionsBuffer create_msg(struct dhcps_msg* m);
 
@@ -209,7 +238,7 @@ protected:
                               uint16_t port);
     void   handle_dhcp(struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, uint16_t port);
     void   kill_oldest_dhcps_pool(void);
-    void   dhcps_coarse_tmr(void);  // CURRENTLY NOT CALLED
+    void   dhcps_coarse_tmr(void);  // every minute while running
     void   dhcps_client_leave(u8* bssid, struct ipv4_addr* ip, bool force);
     uint32 dhcps_client_update(u8* bssid, struct ipv4_addr* ip);
 
@@ -227,8 +256,15 @@ protected:
 
     dhcps_lease lease {};
 
-    list_node* plist = nullptr;
-    bool       renew = false;
+    Lease    leases[LeasePoolSize] {};
+    uint8_t  leaseByMac[LeaseHashSize] {};
+    uint32_t leaseUsed[(LeasePoolSize + 31) / 32] {};
+    uint8_t  leaseHeap[LeasePoolSize] {};
+    uint8_t  leaseHeapLen = 0;
+    uint8_t  leaseCount   = 0;
+    uint32_t leaseClock   = 0;  // minutes, advanced by dhcps_coarse_tmr()
+
+    bool renew = false;
 
     OptionsBufferHandler custom_offer_options = nullptr;
 
@@ -37,6 +37,9 @@
 
 #include <user_interface.h>  // wifi_get_macaddr()
 
+#include <type_traits>
+#include <utility>
+
 #include "SPI.h"
 #include "Schedule.h"
 #include "LwipIntf.h"
@@ -46,6 +49,40 @@
 #define DEFAULT_MTU 1500
 #endif
 
+// frames handled per call, adapted between these bounds to the load
+#ifndef LWIPINTFDEV_RX_BUDGET_MIN
+#define LWIPINTFDEV_RX_BUDGET_MIN 4
+#endif
+#ifndef LWIPINTFDEV_RX_BUDGET_MAX
+#define LWIPINTFDEV_RX_BUDGET_MAX 32
+#endif
+
+// in interrupt mode, the device is still polled at this period
+// in case an edge was missed
+#ifndef LWIPINTFDEV_INTR_POLL_US
+#define LWIPINTFDEV_INTR_POLL_US 100000
+#endif
+
+namespace LwipIntfDevTraits
+{
+// RawDev may optionally provide
+//     uint16_t readFramePart(uint8_t* buffer, uint16_t len);
+// which reads the next len bytes of the frame announced by readFrameSize().
+// The frame is complete when the parts add up to its size.
+// This allows receiving into chained PBUF_POOL buffers.
+template<class T, class = void>
+struct has_readFramePart: std::false_type
+{
+};
+
+template<class T>
+struct has_readFramePart<
+    T, decltype((void)std::declval<T&>().readFramePart((uint8_t*)nullptr, (uint16_t)0))>:
+    std::true_type
+{
+};
+}
+
 enum EthernetLinkStatus
 {
     Unknown,
@@ -130,6 +167,12 @@ protected:
     // called on a regular basis or on interrupt
     err_t handlePackets();
 
+    // receive one frame of tot_len bytes into a pbuf
+    pbuf* readFrame(uint16_t tot_len, std::true_type hasReadFramePart);
+    pbuf* readFrame(uint16_t tot_len, std::false_type hasReadFramePart);
+
+    static void IRAM_ATTR intrHandler_s(void* arg);
+
     // members
 
     netif _netif;
@@ -139,6 +182,8 @@ protected:
     uint8_t  _macAddress[6];
     bool     _started;
     bool     _default;
+    uint8_t  _rxBudget = LWIPINTFDEV_RX_BUDGET_MIN;
+    volatile bool _rxPending = false;  // set by the device interrupt
 };
 
 template<class RawDev>
@@ -262,7 +307,10 @@ boolean LwipIntfDev<RawDev>::Begin(const uint8_t* macAddress, const uint16_t mtu
     {
         if (RawDev::interruptIsPossible())
         {
-            // attachInterrupt(_intrPin, [&]() { this->handlePackets(); }, FALLING);
+            // the interrupt only raises a flag, frames are drained from the
+            // recurrent function below which is alarmed by that flag
+            _rxPending = true;
+            AttachInterruptArg(_intrPin, intrHandler_s, this, FALLING);
         }
         else
         {
@@ -272,15 +320,34 @@ boolean LwipIntfDev<RawDev>::Begin(const uint8_t* macAddress, const uint16_t mtu
         }
     }
 
-    if (_intrPin < 0
-        && !schedule_recurrent_function_us(
+    bool scheduled;
+    if (_intrPin >= 0)
+    {
+        scheduled = schedule_recurrent_function_us(
             [&]()
             {
+                _rxPending = false;
                 this->handlePackets();
                 return true;
             },
-            100))
+            LWIPINTFDEV_INTR_POLL_US, [&]() { return _rxPending; });
+    }
+    else
     {
+        scheduled = schedule_recurrent_function_us(
+            [&]()
+            {
+                this->handlePackets();
+                return true;
+            },
+            100);
+    }
+    if (!scheduled)
+    {
+        if (_intrPin >= 0)
+        {
+            detachInterrupt(_intrPin);
+        }
         netif_remove(&_netif);
         return false;
     }
@@ -387,64 +454,124 @@ void LwipIntfDev<RawDev>::check_route()
     }
 }
 
+template<class RawDev>
+void IRAM_ATTR LwipIntfDev<RawDev>::intrHandler_s(void* arg)
+{
+    ((LwipIntfDev*)arg)->_rxPending = true;
+}
+
+template<class RawDev>
+pbuf* LwipIntfDev<RawDev>::readFrame(uint16_t tot_len, std::true_type)
+{
+    // from doc: use PBUF_RAM for TX, PBUF_POOL from RX
+    // PBUF_POOL can return chained pbuf, filled part by part
+    pbuf* pbuf = pbuf_alloc(PBUF_RAW, tot_len, PBUF_POOL);
+    if (!pbuf)
+    {
+        RawDev::discardFrame(tot_len);
+        return nullptr;
+    }
+
+    for (struct pbuf* q = pbuf; q; q = q->next)
+    {
+        if (RawDev::readFramePart((uint8_t*)q->payload, q->len) != q->len)
+        {
+            DEBUGV("LwipIntfDev: readFramePart short read\r\n");
+            pbuf_free(pbuf);
+            return nullptr;
+        }
+    }
+    return pbuf;
+}
+
+template<class RawDev>
+pbuf* LwipIntfDev<RawDev>::readFrame(uint16_t tot_len, std::false_type)
+{
+    // PBUF_POOL can return chained pbuf (not in one piece)
+    // and this driver has no readFramePart() to deal with that
+    // so we use PBUF_RAM instead which is currently
+    // guarantying to deliver a continuous chunk of memory.
+    pbuf* pbuf = pbuf_alloc(PBUF_RAW, tot_len, PBUF_RAM);
+    if (!pbuf || pbuf->len < tot_len)
+    {
+        if (pbuf)
+        {
+            pbuf_free(pbuf);
+        }
+        RawDev::discardFrame(tot_len);
+        return nullptr;
+    }
+
+    uint16_t len = RawDev::readFrameData((uint8_t*)pbuf->payload, tot_len);
+    if (len != tot_len)
+    {
+        // tot_len is given by readFrameSize()
+        // and is supposed to be honoured by readFrameData()
+        // todo: ensure this test is unneeded, remove the print
+        Serial.println("read error?\r\n");
+        pbuf_free(pbuf);
+        return nullptr;
+    }
+    return pbuf;
+}
+
 template<class RawDev>
 err_t LwipIntfDev<RawDev>::handlePackets()
 {
     int pkt = 0;
     while (1)
     {
-        if (++pkt == 10)
-        // prevent starvation
+        if (pkt == _rxBudget)
+        // prevent starvation, but allow more next time since we are busy
         {
+            if (_rxBudget < LWIPINTFDEV_RX_BUDGET_MAX)
+            {
+                _rxBudget = std::min(2 * _rxBudget, LWIPINTFDEV_RX_BUDGET_MAX);
+            }
+            // frames are left: come back on next yield without waiting
+            // for another interrupt edge
+            _rxPending = true;
             return ERR_OK;
         }
 
         uint16_t tot_len = RawDev::readFrameSize();
         if (!tot_len)
         {
-            return ERR_OK;
-        }
-
-        // from doc: use PBUF_RAM for TX, PBUF_POOL from RX
-        // however:
-        // PBUF_POOL can return chained pbuf (not in one piece)
-        // and WiznetDriver does not have the proper API to deal with that
-        // so in the meantime, we use PBUF_RAM instead which is currently
-        // guarantying to deliver a continuous chunk of memory.
-        // TODO: tweak the wiznet driver to allow copying partial chunk
-        //       of received data and use PBUF_POOL.
-        pbuf* pbuf = pbuf_alloc(PBUF_RAW, tot_len, PBUF_RAM);
-        if (!pbuf || pbuf->len < tot_len)
-        {
-            if (pbuf)
+            if (2 * pkt < _rxBudget && _rxBudget > LWIPINTFDEV_RX_BUDGET_MIN)
             {
-                pbuf_free(pbuf);
+                _rxBudget = std::max(_rxBudget / 2, LWIPINTFDEV_RX_BUDGET_MIN);
             }
-            RawDev::discardFrame(tot_len);
-            return ERR_BUF;
+            return ERR_OK;
         }
+        ++pkt;
 
-        uint16_t len = RawDev::readFrameData((uint8_t*)pbuf->payload, tot_len);
-        if (len != tot_len)
+        pbuf* pbuf = readFrame(tot_len, LwipIntfDevTraits::has_readFramePart<RawDev>());
+        if (!pbuf)
         {
-            // tot_len is given by readFrameSize()
-            // and is supposed to be honoured by readFrameData()
-            // todo: ensure this test is unneeded, remove the print
-            Serial.println("read error?\r\n");
-            pbuf_free(pbuf);
             return ERR_BUF;
         }
 
-        err_t err = _netif.input(pbuf, &_netif);
-
 #if PHY_HAS_CAPTURE
         if (phy_capture)
         {
-            phy_capture(_netif.num, (const char*)pbuf->payload, tot_len, /*out*/ 0,
-                        /*success*/ err == ERR_OK);
+            // before input(): lwIP owns the pbuf afterwards and may have released it already.
+            // A chained frame goes through a bounce buffer so it is captured whole.
+            if (!pbuf->next)
+            {
+                phy_capture(_netif.num, (const char*)pbuf->payload, pbuf->len, /*out*/ 0,
+                            /*success*/ 1);
+            }
+            else if (char* frame = (char*)malloc(pbuf->tot_len))
+            {
+                pbuf_copy_partial(pbuf, frame, pbuf->tot_len, 0);
+                phy_capture(_netif.num, frame, pbuf->tot_len, /*out*/ 0, /*success*/ 1);
+                free(frame);
+            }
         }
 #endif
 
+        err_t err = _netif.input(pbuf, &_netif);
+
         if (err != ERR_OK)
         {
             pbuf_free(pbuf);
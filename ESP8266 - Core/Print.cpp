@@ -253,13 +253,11 @@ template<typename T> size_t PrintClass::PrintNumber(T n, uint8_t base) {
         base = 10;
     }
 
-    do {
-        auto m = n;
-        n /= base;
-        char c = m - base * n;
-
-        *--str = c < 10 ? c + '0' : c + 'A' - 10;
-    } while (n);
+    if (sizeof(n) > sizeof(uint32_t)) {
+        str = ulltoa_backwards(n, str, base, true);
+    } else {
+        str = utoa_backwards(n, str, base, true);
+    }
 
     return Write(str);
 }
@@ -42,14 +42,21 @@ uint32_t *stack_thunk_save = NULL;  /* Saved A1 while in BearSSL */
 uint32_t stack_thunk_refcnt = 0;
 
 /* Largest stack usage seen in the wild at  6120 */
-#define _stackSize (6200/4)
+static size_t _stackSize = (6200/4);
 #define _stackPaint 0xdeadbeef
 
+/* Margin added to the measured peak by stack_thunk_suggest_size() */
+#define _stackMargin 256
+
+static bool stack_thunk_reserved = false;
+static bool stack_thunk_region = false;  /* stack_thunk_ptr is not ours to free */
+static uint32_t stack_thunk_peak = 0;     /* usage of the stacks freed so far */
+
 /* Add a reference, and allocate the stack if necessary */
 void stack_thunk_add_ref()
 {
   stack_thunk_refcnt++;
-  if (stack_thunk_refcnt == 1) {
+  if (stack_thunk_refcnt == 1 && !stack_thunk_ptr) {
     DBG_MMU_PRINTF("\nStackThunk malloc(%u)\n", _stackSize * sizeof(uint32_t));
     // The stack must be in DRAM, or an Soft WDT will follow. Not sure why,
     // maybe too much time is consumed with the non32-bit exception handler.
@@ -77,7 +84,11 @@ void stack_thunk_del_ref()
     return;
   }
   stack_thunk_refcnt--;
-  if (!stack_thunk_refcnt) {
+  if (!stack_thunk_refcnt && !stack_thunk_region) {
+    uint32_t used = stack_thunk_get_max_usage();
+    if (used > stack_thunk_peak) {
+      stack_thunk_peak = used;
+    }
     free(stack_thunk_ptr);
     stack_thunk_ptr = NULL;
     stack_thunk_top = NULL;
@@ -85,9 +96,69 @@ void stack_thunk_del_ref()
   }
 }
 
+void stack_thunk_reserve()
+{
+  if (!stack_thunk_reserved) {
+    stack_thunk_reserved = true;
+    stack_thunk_add_ref();
+  }
+}
+
+void stack_thunk_release()
+{
+  if (stack_thunk_reserved) {
+    stack_thunk_reserved = false;
+    stack_thunk_del_ref();
+  }
+}
+
+bool stack_thunk_set_region(uint32_t *buf, size_t bytes)
+{
+  if (stack_thunk_refcnt || bytes < 16 || ((uint32_t)buf & 15)) {
+    return false;
+  }
+  stack_thunk_ptr = buf;
+  stack_thunk_region = true;
+  _stackSize = bytes / 4;
+  stack_thunk_top = stack_thunk_ptr + _stackSize - 1;
+  stack_thunk_save = NULL;
+  stack_thunk_repaint();
+  return true;
+}
+
+bool stack_thunk_set_size(size_t bytes)
+{
+  if (stack_thunk_refcnt || stack_thunk_region || bytes < 16) {
+    return false;
+  }
+  _stackSize = ((bytes + 15) & ~15) / 4;
+  return true;
+}
+
+size_t stack_thunk_get_size()
+{
+  return _stackSize * sizeof(uint32_t);
+}
+
+uint32_t stack_thunk_get_peak_usage()
+{
+  uint32_t used = stack_thunk_get_max_usage();
+  return (used > stack_thunk_peak) ? used : stack_thunk_peak;
+}
+
+size_t stack_thunk_suggest_size()
+{
+  uint32_t peak = stack_thunk_get_peak_usage();
+  if (!peak) {
+    /* Nothing measured yet */
+    return stack_thunk_get_size();
+  }
+  return (peak + _stackMargin + 15) & ~15;
+}
+
 void stack_thunk_repaint()
 {
-  for (int i=0; i < _stackSize; i++) {
+  for (size_t i=0; i < _stackSize; i++) {
     stack_thunk_ptr[i] = _stackPaint;
   }
 }
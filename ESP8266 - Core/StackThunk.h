@@ -27,6 +27,9 @@
 #ifndef _STACKTHUNK_H
 #define _STACKTHUNK_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -43,6 +46,20 @@ extern uint32_t stack_thunk_get_max_usage();
 extern void stack_thunk_dump_stack();
 extern void stack_thunk_fatal_smashing();
 
+// Keep the stack allocated between TLS sessions instead of freeing it with
+// the last reference, so its watermark accumulates and the heap doesn't churn
+extern void stack_thunk_reserve();
+extern void stack_thunk_release();
+// Use buf (DRAM, 16 byte aligned) as the stack for good, e.g. a static array.
+// Both fail while the stack is in use.
+extern bool stack_thunk_set_region(uint32_t *buf, size_t bytes);
+extern bool stack_thunk_set_size(size_t bytes);
+extern size_t stack_thunk_get_size();
+// Largest usage over every stack allocated since boot
+extern uint32_t stack_thunk_get_peak_usage();
+// Peak usage plus a safety margin, to be passed to stack_thunk_set_size()
+extern size_t stack_thunk_suggest_size();
+
 // Globals required for thunking operation
 extern uint32_t *stack_thunk_ptr;
 extern uint32_t *stack_thunk_top;
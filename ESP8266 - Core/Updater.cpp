@@ -55,6 +55,9 @@ void UpdaterClass::_reset(bool callback) {
   _currentAddress = 0;
   _size = 0;
   _command = U_FLASH;
+  _deltaState = DeltaState::Off;
+  _deltaArgsLen = 0;
+  _deltaDataLeft = 0;
 
   if (callback && _end_callback) {
     _end_callback();
@@ -191,6 +194,14 @@ bool UpdaterClass::Begin(size_t size, int command, int ledPin, uint8_t ledOn) {
 
   if (!_verify) {
     _md5.Begin();
+  } else {
+    // Hash the payload while it is written, the trailing signature
+    // and its length field are excluded up front
+    const uint32_t expectedSigLen = _verify->length();
+    const uint32_t trailer = expectedSigLen ? expectedSigLen + sizeof(uint32_t) : 0;
+    _hashLimit = (_size > trailer)? (_size - trailer) : 0;
+    _hashedLen = 0;
+    _hash->Begin();
   }
 
   if (_start_callback) {
@@ -200,6 +211,16 @@ bool UpdaterClass::Begin(size_t size, int command, int ledPin, uint8_t ledOn) {
   return true;
 }
 
+bool UpdaterClass::beginDelta(size_t size, int ledPin, uint8_t ledOn) {
+  if (!Begin(size, U_FLASH, ledPin, ledOn)) {
+    return false;
+  }
+  _deltaState = DeltaState::Header;
+  _deltaArgsLen = 0;
+  _deltaDataLeft = 0;
+  return true;
+}
+
 bool UpdaterClass::setMD5(const char * expected_md5){
   if(strlen(expected_md5) != 32)
   {
@@ -210,6 +231,7 @@ bool UpdaterClass::setMD5(const char * expected_md5){
 }
 
 bool UpdaterClass::end(bool evenIfRemaining){
+  FlashHalTag flashTag(FLASH_HAL_TAG_UPDATER);
   if(_size == 0){
 #ifdef DEBUG_UPDATER
     DEBUG_UPDATER.println(F("no update"));
@@ -223,6 +245,11 @@ bool UpdaterClass::end(bool evenIfRemaining){
     _setError(UPDATE_ERROR_NO_DATA);
   }
 
+  // A truncated patch leaves the image incomplete even if the size matches
+  if (!hasError() && isDelta() && _deltaState != DeltaState::Done) {
+    _setError(UPDATE_ERROR_DELTA);
+  }
+
   if(hasError() || (!isFinished() && !evenIfRemaining)){
 #ifdef DEBUG_UPDATER
     DEBUG_UPDATER.printf_P(PSTR("premature end: res:%u, pos:%zu/%zu\n"), getError(), progress(), _size);
@@ -276,11 +303,18 @@ bool UpdaterClass::end(bool evenIfRemaining){
 #endif
     }
 
-    // Calculate hash of the payload, 128 bytes at a time
+    // Most of the payload was hashed by _writeBuffer(), only read back what
+    // is missing. If the size shrank (evenIfRemaining) start over.
     alignas(alignof(uint32_t)) uint8_t buff[128];
 
-    _hash->Begin();
-    for (uint32_t offset = 0; offset < binSize; offset += sizeof(buff)) {
+    if (_hashedLen > binSize) {
+      _hash->Begin();
+      _hashedLen = 0;
+    }
+#ifdef DEBUG_UPDATER
+    DEBUG_UPDATER.printf_P(PSTR("[Updater] Hashed while writing: %u, reading back: %zu\n"), _hashedLen, binSize - _hashedLen);
+#endif
+    for (uint32_t offset = _hashedLen; offset < binSize; offset += sizeof(buff)) {
       auto len = std::min(sizeof(buff), binSize - offset);
       ESP.flashRead(_startAddress + offset, reinterpret_cast<uint32_t *>(&buff[0]), len);
       _hash->add(buff, len);
@@ -373,6 +407,7 @@ bool UpdaterClass::end(bool evenIfRemaining){
 }
 
 bool UpdaterClass::_writeBuffer(){
+  FlashHalTag flashTag(FLASH_HAL_TAG_UPDATER);
   #define FLASH_MODE_PAGE  0
   #define FLASH_MODE_OFFSET  2
 
@@ -427,6 +462,14 @@ bool UpdaterClass::_writeBuffer(){
   }
   if (!_verify) {
     _md5.add(_buffer, _bufferLen);
+  } else {
+    // Feed the signature hash with the part of the buffer below the trailer
+    uint32_t offset = _currentAddress - _startAddress;
+    if (offset == _hashedLen && offset < _hashLimit) {
+      size_t len = std::min<size_t>(_bufferLen, _hashLimit - offset);
+      _hash->add(_buffer, len);
+      _hashedLen += len;
+    }
   }
   _currentAddress += _bufferLen;
   _bufferLen = 0;
@@ -437,6 +480,13 @@ size_t UpdaterClass::write(uint8_t *data, size_t len) {
   if(hasError() || !isRunning())
     return 0;
 
+  if (isDelta()) {
+    return _writeDelta(data, len);
+  }
+  return _writeRaw(data, len);
+}
+
+size_t UpdaterClass::_writeRaw(const uint8_t *data, size_t len) {
   if(progress() + _bufferLen + len > _size) {
     _setError(UPDATE_ERROR_SPACE);
     return 0;
@@ -466,6 +516,121 @@ size_t UpdaterClass::write(uint8_t *data, size_t len) {
   return len;
 }
 
+bool UpdaterClass::_copyFromSketch(uint32_t offset, size_t len) {
+  FlashHalTag flashTag(FLASH_HAL_TAG_UPDATER);
+  // the running sketch starts at flash offset 0 and is never below the update area
+  if(offset > ESP.getSketchSize() || len > ESP.getSketchSize() - offset) {
+    _setError(UPDATE_ERROR_DELTA);
+    return false;
+  }
+  if(progress() + _bufferLen + len > _size) {
+    _setError(UPDATE_ERROR_SPACE);
+    return false;
+  }
+
+  // read straight into the write buffer, at most one buffer at a time
+  while(len) {
+    size_t toCopy = std::min(len, _bufferSize - _bufferLen);
+    if(!ESP.flashRead(offset, _buffer + _bufferLen, toCopy)) {
+      _setError(UPDATE_ERROR_READ);
+      return false;
+    }
+    _bufferLen += toCopy;
+    offset += toCopy;
+    len -= toCopy;
+    if(_bufferLen == _bufferSize || _bufferLen == remaining()) {
+      if(!_writeBuffer()) {
+        return false;
+      }
+      if(!_async) yield();
+    }
+  }
+  return true;
+}
+
+size_t UpdaterClass::_writeDelta(const uint8_t *data, size_t len) {
+  static constexpr uint8_t DeltaMagic[4] = { 'E', 'S', 'P', 'D' };
+  static constexpr uint8_t OpEnd = 0x00;
+  static constexpr uint8_t OpCopy = 0x01;
+  static constexpr uint8_t OpData = 0x02;
+
+  auto le32 = [](const uint8_t *p) -> uint32_t {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  };
+
+  size_t pos = 0;
+  while(pos < len && !hasError()) {
+    switch(_deltaState) {
+    case DeltaState::Header:
+      _deltaArgs[_deltaArgsLen++] = data[pos++];
+      if(_deltaArgsLen == sizeof(_deltaArgs)) {
+        if(memcmp(_deltaArgs, DeltaMagic, sizeof(DeltaMagic)) || le32(&_deltaArgs[4]) != _size) {
+          _setError(UPDATE_ERROR_DELTA);
+          return pos;
+        }
+        _deltaArgsLen = 0;
+        _deltaState = DeltaState::Op;
+      }
+      break;
+
+    case DeltaState::Op:
+      _deltaOp = data[pos++];
+      _deltaArgsLen = 0;
+      if(_deltaOp == OpEnd) {
+        _deltaState = DeltaState::Done;
+      } else if(_deltaOp == OpCopy || _deltaOp == OpData) {
+        _deltaState = DeltaState::Args;
+      } else {
+        _setError(UPDATE_ERROR_DELTA);
+        return pos;
+      }
+      break;
+
+    case DeltaState::Args: {
+      size_t argsSize = (_deltaOp == OpCopy)? 8 : 4;
+      _deltaArgs[_deltaArgsLen++] = data[pos++];
+      if(_deltaArgsLen < argsSize) {
+        break;
+      }
+      _deltaArgsLen = 0;
+      if(_deltaOp == OpCopy) {
+        if(!_copyFromSketch(le32(&_deltaArgs[0]), le32(&_deltaArgs[4]))) {
+          return pos;
+        }
+        _deltaState = DeltaState::Op;
+      } else {
+        _deltaDataLeft = le32(&_deltaArgs[0]);
+        _deltaState = _deltaDataLeft ? DeltaState::Data : DeltaState::Op;
+      }
+      break;
+    }
+
+    case DeltaState::Data: {
+      size_t toWrite = std::min<size_t>(_deltaDataLeft, len - pos);
+      size_t written = _writeRaw(data + pos, toWrite);
+      pos += written;
+      if(written != toWrite) {
+        return pos;
+      }
+      _deltaDataLeft -= written;
+      if(!_deltaDataLeft) {
+        _deltaState = DeltaState::Op;
+      }
+      break;
+    }
+
+    case DeltaState::Done:
+      // trailing bytes after the end opcode are a malformed patch
+      _setError(UPDATE_ERROR_DELTA);
+      return pos;
+
+    case DeltaState::Off:
+      return pos;
+    }
+  }
+  return pos;
+}
+
 bool UpdaterClass::_verifyHeader(uint8_t data) {
     if(_command == U_FLASH) {
         // check for valid first magic byte (is always 0xE9)
@@ -483,6 +648,7 @@ bool UpdaterClass::_verifyHeader(uint8_t data) {
 }
 
 bool UpdaterClass::_verifyEnd() {
+    FlashHalTag flashTag(FLASH_HAL_TAG_UPDATER);
     if(_command == U_FLASH) {
 
         uint8_t buf[4] __attribute__((aligned(4)));
@@ -531,6 +697,10 @@ size_t UpdaterClass::writeStream(Stream &data, uint16_t streamTimeOut) {
     if(hasError() || !isRunning())
         return 0;
 
+    if(isDelta()) {
+        return _writeDeltaStream(data, streamTimeOut);
+    }
+
     if(!_verifyHeader(data.Peek())) {
 #ifdef DEBUG_UPDATER
         printError(DEBUG_UPDATER);
@@ -584,6 +754,39 @@ size_t UpdaterClass::writeStream(Stream &data, uint16_t streamTimeOut) {
     return written;
 }
 
+size_t UpdaterClass::_writeDeltaStream(Stream &data, uint16_t streamTimeOut) {
+    // The patch length is unknown, so read what is there until the end opcode
+    uint8_t chunk[256];
+    size_t written = 0;
+    esp8266::PolledTimeOut::oneShotMs TimeOut(streamTimeOut);
+    if (_progress_callback) {
+        _progress_callback(0, _size);
+    }
+
+    while(isRunning() && _deltaState != DeltaState::Done) {
+        size_t bytesToRead = std::min<size_t>(sizeof(chunk), std::max(data.Available(), 1));
+        size_t toRead = data.ReadBytes(chunk, bytesToRead);
+        if(toRead == 0) {
+          if (TimeOut) {
+            _setError(UPDATE_ERROR_STREAM);
+            _reset();
+            return written;
+          }
+          delay(100);
+          continue;
+        }
+        TimeOut.reset();
+        if(write(chunk, toRead) != toRead)
+            return written;
+        written += toRead;
+        if(_progress_callback) {
+            _progress_callback(progress(), _size);
+        }
+        yield();
+    }
+    return written;
+}
+
 void UpdaterClass::_setError(int error){
   _error = error;
   if (_error_callback) {
@@ -649,6 +852,9 @@ String UpdaterClass::getErrorString() const {
   case UPDATE_ERROR_OOM:
     out = F("Out of memory");
     break;
+  case UPDATE_ERROR_DELTA:
+    out = F("Invalid delta patch");
+    break;
   default:
     out = F("UNKNOWN");
     break;
@@ -21,6 +21,7 @@
 #define UPDATE_ERROR_SIGN               (12)
 #define UPDATE_ERROR_NO_DATA            (13)
 #define UPDATE_ERROR_OOM                (14)
+#define UPDATE_ERROR_DELTA              (15)
 
 #define U_FLASH   0
 #define U_FS      100
@@ -68,6 +69,21 @@ class UpdaterClass {
     */
     bool Begin(size_t size, int command = U_FLASH, int ledPin = -1, uint8_t ledOn = LOW);
 
+    /*
+      Same as Begin(size, U_FLASH) but the data passed to write() is a delta
+      patch against the running sketch instead of the raw image.
+      size is the size of the reconstructed image (including any signature).
+
+      Delta format (all integers little endian):
+        header: 'E' 'S' 'P' 'D', uint32 reconstructed size
+        ops:    0x00                          end of patch
+                0x01 uint32 offset uint32 len copy len bytes of the running sketch
+                0x02 uint32 len <len bytes>   insert literal bytes
+      The reconstructed image goes through the normal write path, so MD5
+      and signature verification in end() apply to it unchanged.
+    */
+    bool beginDelta(size_t size, int ledPin = -1, uint8_t ledOn = LOW);
+
     /*
       Run Updater from asynchronous callbacs
     */
@@ -88,6 +104,11 @@ class UpdaterClass {
     */
     size_t writeStream(Stream &data, uint16_t streamTimeout = 60000);
 
+    /*
+      Returns true if the current update applies a delta patch
+    */
+    bool isDelta(){ return _deltaState != DeltaState::Off; }
+
     /*
       If all bytes are written
       this call will write the config to eboot
@@ -179,6 +200,20 @@ class UpdaterClass {
       if (hasError() || !isRunning())
         return 0;
 
+      if (isDelta()) {
+        // patch length is unrelated to remaining(), feed the decoder in chunks
+        uint8_t chunk[128];
+        size_t available = data.available();
+        while (available && _deltaState != DeltaState::Done) {
+          size_t toRead = data.read(chunk, std::min(available, sizeof(chunk)));
+          if (write(chunk, toRead) != toRead)
+            return written;
+          written += toRead;
+          available = data.available();
+        }
+        return written;
+      }
+
       size_t available = data.available();
       while(available) {
         if(_bufferLen + available > remaining()){
@@ -210,8 +245,21 @@ class UpdaterClass {
     }
 
   private:
+    enum class DeltaState : uint8_t {
+      Off,      // raw (or gzipped) image
+      Header,   // collecting magic and reconstructed size
+      Op,       // waiting for the next opcode
+      Args,     // collecting opcode arguments
+      Data,     // copying literal bytes
+      Done      // end opcode seen
+    };
+
     void _reset(bool callback = true);
     bool _writeBuffer();
+    size_t _writeRaw(const uint8_t *data, size_t len);
+    size_t _writeDelta(const uint8_t *data, size_t len);
+    bool _copyFromSketch(uint32_t offset, size_t len);
+    size_t _writeDeltaStream(Stream &data, uint16_t streamTimeOut);
 
     bool _verifyHeader(uint8_t data);
     bool _verifyEnd();
@@ -228,6 +276,13 @@ class UpdaterClass {
     uint32_t _currentAddress = 0;
     uint32_t _command = U_FLASH;
 
+    // Delta patch decoder state
+    DeltaState _deltaState = DeltaState::Off;
+    uint8_t _deltaOp = 0;
+    uint8_t _deltaArgs[8];
+    size_t _deltaArgsLen = 0;
+    uint32_t _deltaDataLeft = 0;
+
     String _target_md5;
     MD5Builder _md5;
 
@@ -237,6 +292,8 @@ class UpdaterClass {
     // Optional signed binary verification
     UpdaterHashClass *_hash = nullptr;
     UpdaterVerifyClass *_verify = nullptr;
+    uint32_t _hashLimit = 0; // payload size covered by the signature, as expected at Begin()
+    uint32_t _hashedLen = 0; // payload bytes already fed to _hash while writing
 
     // Optional lifetime callback functions
     THandlerFunction_Progress _progress_callback = nullptr;
@@ -22,6 +22,7 @@
 #define CONT_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifndef CONT_STACKSIZE
 #define CONT_STACKSIZE 4096
@@ -39,21 +40,34 @@ typedef struct cont_ {
         unsigned* sp_suspend;
 
         unsigned* stack_end;
-        unsigned unused1;
+        void* heap_block;
         unsigned unused2;
         unsigned stack_guard1;
 
+        // cont_create() continuations have a stack of their own size; the
+        // guard and struct_start words then follow at stack_end instead.
         unsigned stack[CONT_STACKSIZE / 4];
 
         unsigned stack_guard2;
         unsigned* struct_start;
 } cont_t;
 
+// The continuation currently running, or the loop() one when in SYS
 extern cont_t* g_pcont;
 
 // Initialize the cont_t structure before calling cont_run
 void cont_init(cont_t*);
 
+// Allocate and initialize a continuation with a stack of stack_size bytes,
+// rounded up to 16. Returns NULL when out of memory.
+cont_t* cont_create(size_t stack_size);
+
+// Free a continuation allocated by cont_create
+void cont_destroy(cont_t*);
+
+// Size of the stack in bytes
+size_t cont_get_stack_size(cont_t* cont);
+
 // Run function pfn in a separate stack, or continue execution
 // at the point where cont_suspend was called
 void cont_run(cont_t*, void (*pfn)(void));
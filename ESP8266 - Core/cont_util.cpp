@@ -21,6 +21,7 @@
 #include <ets_sys.h>
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "cont.h"
@@ -46,9 +47,47 @@ void cont_init(cont_t* cont) {
     }
 }
 
+cont_t* cont_create(size_t stack_size) {
+    // Keep stack_end 16 bytes aligned as the call0 ABI expects, the header
+    // before the stack is a multiple of 16 already
+    const size_t words = ((stack_size + 15) & ~15) / 4;
+    const size_t header = offsetof(cont_t, stack);
+    void* block = malloc(header + words * 4 + 2 * sizeof(unsigned) + 15);
+    if (!block) {
+        return nullptr;
+    }
+
+    cont_t* cont = (cont_t*) (((uintptr_t) block + 15) & ~(uintptr_t) 15);
+    memset(cont, 0, header);
+
+    cont->heap_block = block;
+    cont->stack_guard1 = CONT_STACKGUARD;
+    cont->stack_end = cont->stack + words;
+    cont->stack_end[0] = CONT_STACKGUARD;       // stack_guard2
+    cont->stack_end[1] = (unsigned) cont;       // struct_start, used by cont_norm
+
+    for(size_t pos = 0; pos < words; pos++)
+    {
+        cont->stack[pos] = CONT_STACKGUARD;
+    }
+
+    return cont;
+}
+
+void cont_destroy(cont_t* cont) {
+    if (cont && cont->heap_block) {
+        free(cont->heap_block);
+    }
+}
+
+size_t cont_get_stack_size(cont_t* cont) {
+    return (cont->stack_end - cont->stack) * 4;
+}
+
 void IRAM_ATTR cont_check(cont_t* cont) {
+    // stack_end points at stack_guard2, wherever the stack size put it
     if ((cont->stack_guard1 == CONT_STACKGUARD)
-     && (cont->stack_guard2 == CONT_STACKGUARD))
+     && (*cont->stack_end == CONT_STACKGUARD))
     {
         return;
     }
@@ -0,0 +1,191 @@
+/*
+ core_esp8266_crashlog.cpp - compact crash records kept across resets
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include "Arduino.h"
+#include "Esp.h"
+#include "Print.h"
+#include "core_esp8266_crashlog.h"
+
+extern "C" {
+#include "spi_flash.h"
+#include "user_interface.h"
+}
+
+extern struct rst_info resetInfo;
+
+static_assert(sizeof(crashlog_record_t) <= CRASHLOG_SLOT_SIZE, "crash record larger than its flash slot");
+static_assert(CRASHLOG_RTC_OFFSET * 4 + sizeof(crashlog_record_t) <= 512, "crash record beyond RTC user memory");
+
+#define CRASHLOG_SLOTS (SPI_FLASH_SEC_SIZE / CRASHLOG_SLOT_SIZE)
+
+extern "C" {
+
+uint32_t __crashlog_flash_sector(void) {
+    return 0;
+}
+
+uint32_t crashlog_flash_sector(void) __attribute__((weak, alias("__crashlog_flash_sector")));
+
+static bool crashlog_valid(const crashlog_record_t* rec) {
+    return rec->magic == CRASHLOG_MAGIC && rec->check == crashlog_checksum(rec);
+}
+
+static bool crashlog_rtc_read(crashlog_record_t* rec) {
+    return ESP.rtcUserMemoryRead(CRASHLOG_RTC_OFFSET, (uint32_t*)rec, sizeof(*rec))
+        && crashlog_valid(rec);
+}
+
+static void crashlog_rtc_write(crashlog_record_t* rec) {
+    rec->check = crashlog_checksum(rec);
+    ESP.rtcUserMemoryWrite(CRASHLOG_RTC_OFFSET, (uint32_t*)rec, sizeof(*rec));
+}
+
+static void crashlog_rtc_clear(void) {
+    uint32_t zero = 0;
+    ESP.rtcUserMemoryWrite(CRASHLOG_RTC_OFFSET, &zero, sizeof(zero));
+}
+
+static bool crashlog_flash_read(uint32_t slot, crashlog_record_t* rec) {
+    const uint32_t address = crashlog_flash_sector() * SPI_FLASH_SEC_SIZE + slot * CRASHLOG_SLOT_SIZE;
+    return ESP.flashRead(address, (uint32_t*)rec, sizeof(*rec));
+}
+
+// Appends to the flash log, starting over once the sector is full
+static void crashlog_flash_append(crashlog_record_t* rec) {
+    const uint32_t sector = crashlog_flash_sector();
+    crashlog_record_t old;
+    uint32_t slot = 0;
+    uint32_t seq = 0;
+
+    for (; slot < CRASHLOG_SLOTS; slot++) {
+        if (!crashlog_flash_read(slot, &old) || old.magic == 0xffffffff) {
+            break;
+        }
+        if (crashlog_valid(&old)) {
+            seq = old.seq;
+        }
+    }
+    if (slot == CRASHLOG_SLOTS) {
+        ESP.flashEraseSector(sector);
+        slot = 0;
+    }
+
+    rec->seq = seq + 1;
+    rec->check = crashlog_checksum(rec);
+    ESP.flashWrite(sector * SPI_FLASH_SEC_SIZE + slot * CRASHLOG_SLOT_SIZE, (const uint32_t*)rec, sizeof(*rec));
+}
+
+void crashlog_boot(void) {
+    if (!CRASHLOG_ENABLE) {
+        return;
+    }
+
+    crashlog_record_t rec;
+    const bool saved = crashlog_rtc_read(&rec);
+
+    if (!saved || rec.seq != CRASHLOG_SEQ_NEW) {
+        if (saved && rec.seq == CRASHLOG_SEQ_PREVIOUS) {
+            // the run that just ended didn't end with it
+            rec.seq = CRASHLOG_SEQ_OLDER;
+            crashlog_rtc_write(&rec);
+        }
+        // Nothing saved by this reset, e.g. hardware WDT without the hwdt
+        // handler: what the SDK kept still tells where it happened
+        if (resetInfo.reason != REASON_WDT_RST &&
+            resetInfo.reason != REASON_EXCEPTION_RST &&
+            resetInfo.reason != REASON_SOFT_WDT_RST)
+        {
+            return;
+        }
+        memset(&rec, 0, sizeof(rec));
+        rec.reason = resetInfo.reason;
+        rec.exccause = resetInfo.exccause;
+        rec.epc1 = resetInfo.epc1;
+        rec.epc2 = resetInfo.epc2;
+        rec.epc3 = resetInfo.epc3;
+        rec.excvaddr = resetInfo.excvaddr;
+        rec.depc = resetInfo.depc;
+        crashlog_save(&rec);
+    }
+
+    if (crashlog_flash_sector()) {
+        crashlog_flash_append(&rec);
+        crashlog_rtc_clear();
+    } else {
+        // consumed, the next boot won't take it for a new crash
+        rec.seq = CRASHLOG_SEQ_PREVIOUS;
+        crashlog_rtc_write(&rec);
+    }
+}
+
+size_t crashlog_read(bool (*cb)(const crashlog_record_t* rec, void* arg), void* arg) {
+    crashlog_record_t rec;
+    size_t count = 0;
+
+    if (!CRASHLOG_ENABLE) {
+        return 0;
+    }
+
+    if (crashlog_flash_sector()) {
+        // oldest first: after a wrap the log restarts at slot 0, so it's in order
+        for (uint32_t slot = 0; slot < CRASHLOG_SLOTS; slot++) {
+            if (!crashlog_flash_read(slot, &rec) || rec.magic == 0xffffffff) {
+                break;
+            }
+            if (!crashlog_valid(&rec)) {
+                continue;
+            }
+            count++;
+            if (!cb(&rec, arg)) {
+                return count;
+            }
+        }
+    }
+    if (crashlog_rtc_read(&rec)) {
+        count++;
+        cb(&rec, arg);
+    }
+    return count;
+}
+
+void crashlog_clear(void) {
+    if (!CRASHLOG_ENABLE) {
+        return;
+    }
+    if (crashlog_flash_sector()) {
+        ESP.flashEraseSector(crashlog_flash_sector());
+    }
+    crashlog_rtc_clear();
+}
+
+};
+
+size_t crashlog_dump(PrintClass& out) {
+    struct dump_t {
+        PrintClass* out;
+        size_t bytes;
+    } dump = { &out, 0 };
+
+    crashlog_read([](const crashlog_record_t* rec, void* arg) {
+        dump_t* dump = (dump_t*)arg;
+        dump->bytes += dump->out->Write((const uint8_t*)rec, sizeof(*rec));
+        return true;
+    }, &dump);
+    return dump.bytes;
+}
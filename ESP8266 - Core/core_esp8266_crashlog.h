@@ -0,0 +1,144 @@
+/*
+ core_esp8266_crashlog.h - compact crash records kept across resets
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+   The postmortem and hardware WDT handlers save one record in RTC user
+   memory, which survives the reset. At the next boot it is appended to
+   a flash sector set aside by crashlog_flash_sector(), when there is one,
+   so the log also survives power loss. Records are stored as is, little
+   endian, CRASHLOG_SLOT_SIZE bytes apart, for a host side decoder.
+*/
+
+#ifndef CORE_ESP8266_CRASHLOG_H
+#define CORE_ESP8266_CRASHLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CRASHLOG_MAGIC        0x474f4c43 // "CLOG"
+#define CRASHLOG_TRACE_WORDS  16
+#define CRASHLOG_SLOT_SIZE    128
+
+// seq of a record kept in RTC memory: just saved by the crash, how the
+// previous run ended, or older than that
+#define CRASHLOG_SEQ_NEW      0
+#define CRASHLOG_SEQ_PREVIOUS 0xfffffffe
+#define CRASHLOG_SEQ_OLDER    0xffffffff
+
+// Off unless built with -DCRASHLOG_ENABLE=1, as it takes RTC user memory
+// sketches may already use
+#ifndef CRASHLOG_ENABLE
+#define CRASHLOG_ENABLE       0
+#endif
+
+// Position in ESP.rtcUserMemory, in 4 byte blocks. The record takes the
+// last 120 bytes, sketches using RTC memory must stay below it.
+#ifndef CRASHLOG_RTC_OFFSET
+#define CRASHLOG_RTC_OFFSET   98
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct crashlog_record_ {
+    uint32_t magic;
+    uint32_t seq;               // position in the flash log, or a CRASHLOG_SEQ_ state in RTC memory
+    uint8_t  reason;            // rst_info.reason, or 253 stack smash, 254 panic/abort
+    uint8_t  exccause;
+    uint16_t trace_len;         // entries used in trace[]
+    uint32_t epc1;
+    uint32_t epc2;
+    uint32_t epc3;
+    uint32_t excvaddr;
+    uint32_t depc;
+    uint32_t uptime_ms;
+    uint32_t free_heap;
+    uint32_t cont_free_stack;   // cont stack high water mark, bytes never used
+    uint32_t thunk_peak;        // BearSSL stack peak usage
+    uint32_t sp;
+    uint32_t trace[CRASHLOG_TRACE_WORDS]; // code addresses found on the stack, innermost first
+    uint32_t check;             // crashlog_checksum() of the words above
+} crashlog_record_t;
+
+// Flash sector (address / SPI_FLASH_SEC_SIZE) holding the log, 0 by default
+// to only keep the last record in RTC memory. Redefine it to point at a
+// sector kept out of the filesystem and EEPROM.
+uint32_t crashlog_flash_sector(void);
+
+// Moves a record left in RTC memory by the previous run to flash, and
+// records resets that left none (e.g. hardware WDT without DEBUG_ESP_HWDT).
+// Called by the core at boot.
+void crashlog_boot(void);
+
+// Calls cb with every record, oldest first, until it returns false. The
+// last one may be the RTC memory record, its seq tells whether the previous
+// run ended with it. Returns the number of records visited.
+size_t crashlog_read(bool (*cb)(const crashlog_record_t* rec, void* arg), void* arg);
+
+void crashlog_clear(void);
+
+// Only uses the CPU, so it's fine from the exception handlers and before
+// the flash cache is up
+static inline uint32_t crashlog_checksum(const crashlog_record_t* rec) {
+    const uint32_t* words = (const uint32_t*)rec;
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < offsetof(crashlog_record_t, check) / 4; i++) {
+        a += words[i];
+        b += a;
+    }
+    return a ^ (b << 16) ^ (b >> 16);
+}
+
+// Adds the words between start and end that look like return addresses
+static inline void crashlog_add_trace(crashlog_record_t* rec, uint32_t start, uint32_t end) {
+    for (uint32_t pos = start & ~3u; pos < end && rec->trace_len < CRASHLOG_TRACE_WORDS; pos += 4) {
+        const uint32_t v = *(const uint32_t*)pos;
+        if ((v >= 0x40100000 && v < 0x40110000) || (v >= 0x40200000 && v < 0x40300000)) {
+            rec->trace[rec->trace_len++] = v;
+        }
+    }
+}
+
+// Writes straight to RTC memory, without the SDK
+static inline void crashlog_save(crashlog_record_t* rec) {
+#if !CRASHLOG_ENABLE
+    (void)rec;
+#else
+    volatile uint32_t* rtc = (volatile uint32_t*)(0x60001200 + CRASHLOG_RTC_OFFSET * 4);
+    const uint32_t* words = (const uint32_t*)rec;
+    rec->magic = CRASHLOG_MAGIC;
+    rec->seq = CRASHLOG_SEQ_NEW;
+    rec->check = crashlog_checksum(rec);
+    for (size_t i = 0; i < sizeof(crashlog_record_t) / 4; i++) {
+        rtc[i] = words[i];
+    }
+#endif
+}
+
+#ifdef __cplusplus
+}
+
+class PrintClass;
+
+// Writes every record as raw bytes, returns the byte count
+size_t crashlog_dump(PrintClass& out);
+#endif
+
+#endif // CORE_ESP8266_CRASHLOG_H
@@ -28,8 +28,10 @@
 
 extern "C" {
 
-#define SLC_BUF_CNT (8)  // Number of buffers in the I2S circular buffer
-#define SLC_BUF_LEN (64) // Length of one buffer, in 32-bit words.
+#define SLC_BUF_CNT (8)  // Default number of buffers in the I2S circular buffer
+#define SLC_BUF_LEN (64) // Default length of one buffer, in 32-bit words.
+#define SLC_BUF_CNT_MAX (255) // slc_queue_len is a byte
+#define SLC_BUF_LEN_MAX (1023) // datalen and blocksize are 12-bit byte counts
 
 // We use a queue to keep track of the DMA buffers that are empty. The ISR
 // will push buffers to the back of the queue, the I2S transmitter will pull
@@ -54,16 +56,19 @@ typedef struct slc_queue_item {
 } slc_queue_item_t;
 
 typedef struct i2s_state {
-  uint32_t *       slc_queue[SLC_BUF_CNT];
+  uint32_t **      slc_queue; // _i2s_buf_cnt entries
   volatile uint8_t slc_queue_len;
-  uint32_t *       slc_buf_pntr[SLC_BUF_CNT]; // Pointer to the I2S DMA buffer data
-  slc_queue_item_t slc_items[SLC_BUF_CNT]; // I2S DMA buffer descriptors
+  uint32_t **      slc_buf_pntr; // Pointer to the I2S DMA buffer data
+  slc_queue_item_t *slc_items; // I2S DMA buffer descriptors
   uint32_t *       curr_slc_buf; // Current buffer for writing
   uint32_t         curr_slc_buf_pos; // Position in the current buffer
+  volatile uint32_t xruns; // TX underruns / RX overruns, counted in the ISR
   void             (*callback) (void);
   // Callback function should be defined as 'void IRAM_ATTR function_name()',
   // and be placed in IRAM for faster execution. Avoid long computational tasks in this
   // function, use it to set flags and process later.
+  void             (*watermark_callback) (void);
+  uint8_t          watermark; // watermark_callback runs when slc_queue_len reaches this
   bool             driveClocks;
 } i2s_state_t;
 
@@ -74,6 +79,8 @@ static i2s_state_t *tx = NULL;
 // Last I2S sample rate requested
 static uint32_t _i2s_sample_rate;
 static int _i2s_bits = 16;
+static uint16_t _i2s_buf_cnt = SLC_BUF_CNT;
+static uint16_t _i2s_buf_len = SLC_BUF_LEN;
 
 // IOs used for I2S. Not defined in i2s.h, unfortunately.
 // Note these are internal GPIO numbers and not pins on an
@@ -93,11 +100,20 @@ bool i2s_set_bits(int bits) {
   return true;
 }
 
+bool i2s_set_buffers(uint16_t count, uint16_t words) {
+  if (tx || rx || count < 2 || count > SLC_BUF_CNT_MAX || words < 1 || words > SLC_BUF_LEN_MAX) {
+    return false;
+  }
+  _i2s_buf_cnt = count;
+  _i2s_buf_len = words;
+  return true;
+}
+
 static bool _i2s_is_full(const i2s_state_t *ch) {
   if (!ch) {
     return false;
   }
-  return (ch->curr_slc_buf_pos==SLC_BUF_LEN || ch->curr_slc_buf==NULL) && (ch->slc_queue_len == 0);
+  return (ch->curr_slc_buf_pos==_i2s_buf_len || ch->curr_slc_buf==NULL) && (ch->slc_queue_len == 0);
 }
 
 bool i2s_is_full() {
@@ -112,7 +128,7 @@ static bool _i2s_is_empty(const i2s_state_t *ch) {
   if (!ch) {
     return false;
   }
-  return (ch->slc_queue_len >= SLC_BUF_CNT-1);
+  return (ch->slc_queue_len >= _i2s_buf_cnt-1);
 }
 
 bool i2s_is_empty() {
@@ -127,7 +143,7 @@ static uint16_t _i2s_available(const i2s_state_t *ch) {
   if (!ch) {
     return 0;
   }
-  return (SLC_BUF_CNT - ch->slc_queue_len) * SLC_BUF_LEN;
+  return std::min<uint32_t>((_i2s_buf_cnt - ch->slc_queue_len) * _i2s_buf_len, 0xffff);
 }
 
 uint16_t i2s_available(){
@@ -157,10 +173,11 @@ static void IRAM_ATTR i2s_slc_queue_append_item(i2s_state_t *ch, uint32_t *item)
       ch->slc_queue[dest++] = ch->slc_queue[i];
     }
   }
-  if (ch->slc_queue_len < SLC_BUF_CNT - 1) {
+  if (ch->slc_queue_len < _i2s_buf_cnt - 1) {
     ch->slc_queue[ch->slc_queue_len++] = item;
   } else {
     ch->slc_queue[ch->slc_queue_len] = item;
+    ch->xruns++; // Reader fell behind, the oldest received buffer was overwritten
   }
 }
 
@@ -171,15 +188,19 @@ static void IRAM_ATTR i2s_slc_isr(void) {
   if (slc_intr_status & SLCIRXEOF) {
     slc_queue_item_t *finished_item = (slc_queue_item_t *)SLCRXEDA;
     // Zero the buffer so it is mute in case of underflow
-    ets_memset((void *)finished_item->buf_ptr, 0x00, SLC_BUF_LEN * 4);
-    if (tx->slc_queue_len >= SLC_BUF_CNT-1) {
+    ets_memset((void *)finished_item->buf_ptr, 0x00, _i2s_buf_len * 4);
+    if (tx->slc_queue_len >= _i2s_buf_cnt-1) {
       // All buffers are empty. This means we have an underflow
       i2s_slc_queue_next_item(tx); // Free space for finished_item
+      tx->xruns++;
     }
     tx->slc_queue[tx->slc_queue_len++] = finished_item->buf_ptr;
     if (tx->callback) {
       tx->callback();
     }
+    if (tx->watermark_callback && tx->slc_queue_len == tx->watermark) {
+      tx->watermark_callback();
+    }
   }
   if (slc_intr_status & SLCITXEOF) {
     slc_queue_item_t *finished_item = (slc_queue_item_t *)SLCTXEDA;
@@ -189,6 +210,9 @@ static void IRAM_ATTR i2s_slc_isr(void) {
     if (rx->callback) {
       rx->callback();
     }
+    if (rx->watermark_callback && rx->slc_queue_len == rx->watermark) {
+      rx->watermark_callback();
+    }
   }
   ETS_SLC_INTR_ENABLE();
 }
@@ -201,24 +225,51 @@ void i2s_rx_set_callback(void (*callback) (void)) {
   if (rx) rx->callback = callback;
 }
 
+// Unlike the per-buffer callbacks these only fire once when the number of free (TX) or filled
+// (RX) buffers reaches 'buffers', so a producer or consumer can sleep until there is a batch
+// worth of work.
+static void _i2s_set_watermark_callback(i2s_state_t *ch, uint8_t buffers, void (*callback) (void)) {
+  if (!ch) {
+    return;
+  }
+  ETS_SLC_INTR_DISABLE();
+  ch->watermark = std::max<uint8_t>(1, std::min<uint16_t>(buffers, _i2s_buf_cnt - 1));
+  ch->watermark_callback = callback;
+  ETS_SLC_INTR_ENABLE();
+}
+
+void i2s_set_watermark_callback(uint8_t buffers, void (*callback) (void)) {
+  _i2s_set_watermark_callback(tx, buffers, callback);
+}
+
+void i2s_rx_set_watermark_callback(uint8_t buffers, void (*callback) (void)) {
+  _i2s_set_watermark_callback(rx, buffers, callback);
+}
+
 static bool _alloc_channel(i2s_state_t *ch) {
   ch->slc_queue_len = 0;
-  for (int x=0; x<SLC_BUF_CNT; x++) {
-    ch->slc_buf_pntr[x] = (uint32_t *)malloc(SLC_BUF_LEN * sizeof(ch->slc_buf_pntr[0][0]));
+  ch->slc_queue = (uint32_t **)calloc(_i2s_buf_cnt, sizeof(ch->slc_queue[0]));
+  ch->slc_buf_pntr = (uint32_t **)calloc(_i2s_buf_cnt, sizeof(ch->slc_buf_pntr[0]));
+  ch->slc_items = (slc_queue_item_t *)calloc(_i2s_buf_cnt, sizeof(ch->slc_items[0]));
+  if (!ch->slc_queue || !ch->slc_buf_pntr || !ch->slc_items) {
+    return false;
+  }
+  for (int x=0; x<_i2s_buf_cnt; x++) {
+    ch->slc_buf_pntr[x] = (uint32_t *)malloc(_i2s_buf_len * sizeof(ch->slc_buf_pntr[0][0]));
     if (!ch->slc_buf_pntr[x]) {
       // OOM, the upper layer will free up any partially allocated channels.
       return false;
     }
-    memset(ch->slc_buf_pntr[x], 0, SLC_BUF_LEN * sizeof(ch->slc_buf_pntr[x][0]));
+    memset(ch->slc_buf_pntr[x], 0, _i2s_buf_len * sizeof(ch->slc_buf_pntr[x][0]));
 
     ch->slc_items[x].unused = 0;
     ch->slc_items[x].owner = 1;
     ch->slc_items[x].eof = 1;
     ch->slc_items[x].sub_sof = 0;
-    ch->slc_items[x].datalen = SLC_BUF_LEN * 4;
-    ch->slc_items[x].blocksize = SLC_BUF_LEN * 4;
+    ch->slc_items[x].datalen = _i2s_buf_len * 4;
+    ch->slc_items[x].blocksize = _i2s_buf_len * 4;
     ch->slc_items[x].buf_ptr = (uint32_t*)&ch->slc_buf_pntr[x][0];
-    ch->slc_items[x].next_link_ptr = (x<(SLC_BUF_CNT-1))?(&ch->slc_items[x+1]):(&ch->slc_items[0]);
+    ch->slc_items[x].next_link_ptr = (x<(_i2s_buf_cnt-1))?(&ch->slc_items[x+1]):(&ch->slc_items[0]);
   }
   return true;
 }
@@ -284,33 +335,34 @@ static void i2s_slc_end(){
   SLCTXL &= ~(SLCTXLAM << SLCTXLA); // clear TX descriptor address
   SLCRXL &= ~(SLCRXLAM << SLCRXLA); // clear RX descriptor address
 
-  for (int x = 0; x<SLC_BUF_CNT; x++) {
-    if (tx) {
-      free(tx->slc_buf_pntr[x]);
-      tx->slc_buf_pntr[x] = NULL;
+  i2s_state_t *channels[] = { tx, rx };
+  for (i2s_state_t *ch : channels) {
+    if (!ch) {
+      continue;
     }
-    if (rx) {
-      free(rx->slc_buf_pntr[x]);
-      rx->slc_buf_pntr[x] = NULL;
+    for (int x = 0; ch->slc_buf_pntr && x<_i2s_buf_cnt; x++) {
+      free(ch->slc_buf_pntr[x]);
     }
+    free(ch->slc_buf_pntr);
+    free(ch->slc_items);
+    free(ch->slc_queue);
+    ch->slc_buf_pntr = NULL;
+    ch->slc_items = NULL;
+    ch->slc_queue = NULL;
   }
 }
 
-// These routines push a single, 32-bit sample to the I2S buffers. Call at (on average)
-// at least the current sample rate.
-static bool _i2s_write_sample(uint32_t sample, bool nb) {
-  if (!tx) {
-    return false;
-  }
-
-  if (tx->curr_slc_buf_pos==SLC_BUF_LEN || tx->curr_slc_buf==NULL) {
-    if (tx->slc_queue_len == 0) {
-      if (nb) {
+// Make sure the channel has a current buffer with room left, taking the next one from the
+// queue if needed.  Returns the number of words left in it, 0 if none is free and !blocking.
+static uint16_t _i2s_acquire(i2s_state_t *ch, bool blocking) {
+  if (ch->curr_slc_buf_pos==_i2s_buf_len || ch->curr_slc_buf==NULL) {
+    if (ch->slc_queue_len == 0) {
+      if (!blocking) {
         // Don't wait if nonblocking, just notify upper levels
-        return false;
+        return 0;
       }
       while (1) {
-        if (tx->slc_queue_len > 0) {
+        if (ch->slc_queue_len > 0) {
           break;
         } else {
           optimistic_yield(10000);
@@ -318,9 +370,22 @@ static bool _i2s_write_sample(uint32_t sample, bool nb) {
       }
     }
     ETS_SLC_INTR_DISABLE();
-    tx->curr_slc_buf = (uint32_t *)i2s_slc_queue_next_item(tx);
+    ch->curr_slc_buf = (uint32_t *)i2s_slc_queue_next_item(ch);
     ETS_SLC_INTR_ENABLE();
-    tx->curr_slc_buf_pos=0;
+    ch->curr_slc_buf_pos=0;
+  }
+  return _i2s_buf_len - ch->curr_slc_buf_pos;
+}
+
+// These routines push a single, 32-bit sample to the I2S buffers. Call at (on average)
+// at least the current sample rate.
+static bool _i2s_write_sample(uint32_t sample, bool nb) {
+  if (!tx) {
+    return false;
+  }
+
+  if (!_i2s_acquire(tx, !nb)) {
+    return false;
   }
   tx->curr_slc_buf[tx->curr_slc_buf_pos++]=sample;
   return true;
@@ -341,60 +406,86 @@ bool i2s_write_lr(int16_t left, int16_t right){
   return i2s_write_sample(sample);
 }
 
+// Packing kernels.  When the source is word aligned two int16_t are loaded at once (first one
+// in the low half, the ESP8266 is little endian) and the output words are built with shifts and
+// masks, instead of two halfword loads and extensions per output word.
+void i2s_pack_mono(uint32_t *dst, const int16_t *src, uint16_t count) {
+  if (((uintptr_t)src & 3) && count) {
+    uint16_t v = (uint16_t)(*src++);
+    *dst++ = (v << 16) | v;
+    count--;
+  }
+  const uint32_t *w = (const uint32_t *)src;
+  for (; count >= 2; count -= 2) {
+    uint32_t v = *w++;
+    *dst++ = (v << 16) | (v & 0xffff);
+    *dst++ = (v & 0xffff0000) | (v >> 16);
+  }
+  if (count) {
+    uint16_t v = *(const uint16_t *)w;
+    *dst = (v << 16) | v;
+  }
+}
+
+void i2s_pack_stereo(uint32_t *dst, const int16_t *src, uint16_t count) {
+  if ((uintptr_t)src & 3) {
+    while (count--) {
+      uint16_t v1 = (uint16_t)(*src++);
+      uint16_t v2 = (uint16_t)(*src++);
+      *dst++ = (v1 << 16) | v2;
+    }
+    return;
+  }
+  // A whole frame is one aligned word, swapping its halves gives the DMA layout
+  const uint32_t *w = (const uint32_t *)src;
+  while (count--) {
+    uint32_t v = *w++;
+    *dst++ = (v << 16) | (v >> 16);
+  }
+}
+
+void i2s_pack_24(uint32_t *dst, const int16_t *src, uint16_t count) {
+  if (((uintptr_t)src & 3) && count) {
+    *dst++ = (uint32_t)(uint16_t)(*src++) << 16;
+    count--;
+  }
+  const uint32_t *w = (const uint32_t *)src;
+  for (; count >= 2; count -= 2) {
+    uint32_t v = *w++;
+    *dst++ = v << 16;
+    *dst++ = v & 0xffff0000;
+  }
+  if (count) {
+    *dst = (uint32_t)(*(const uint16_t *)w) << 16;
+  }
+}
+
 // writes a buffer of frames into the DMA memory, returns the amount of frames written
 // A frame is just a int16_t for mono, for stereo a frame is two int16_t, one for each channel.
 static uint16_t _i2s_write_buffer(const int16_t *frames, uint16_t frame_count, bool mono, bool nb) {
     uint16_t frames_written=0;
 
     while(frame_count>0) {
-   
-        // make sure we have room in the current buffer
-        if (tx->curr_slc_buf_pos==SLC_BUF_LEN || tx->curr_slc_buf==NULL) {
-            // no room in the current buffer? if there are no buffers available then exit
-            if (tx->slc_queue_len == 0)
-            {
-                if (nb) {
-                    // if nonblocking just return the number of frames written so far
-                    break;
-                }
-                else {
-                    while (1) {
-                        if (tx->slc_queue_len > 0) {
-                          break;
-                        } else {
-                          optimistic_yield(10000);
-                        }
-                    }
-                }
-            }
-            
-            // get a new buffer
-            ETS_SLC_INTR_DISABLE();
-            tx->curr_slc_buf = (uint32_t *)i2s_slc_queue_next_item(tx);
-            ETS_SLC_INTR_ENABLE();
-            tx->curr_slc_buf_pos=0;
-        }       
-
-        //space available in the current buffer
-        uint16_t	available = SLC_BUF_LEN - tx->curr_slc_buf_pos;
+        // make sure we have room in the current buffer, if nonblocking and there is none just
+        // return the number of frames written so far
+        uint16_t available = _i2s_acquire(tx, !nb);
+        if (!available) {
+            break;
+        }
 
         uint16_t fc = (available < frame_count) ? available : frame_count;
 
         if (mono) {
-            for(uint16_t i=0;i<fc;i++){
-                uint16_t v = (uint16_t)(*frames++);
-                tx->curr_slc_buf[tx->curr_slc_buf_pos++] = (v << 16) | v;               
-            }                
+            i2s_pack_mono(&tx->curr_slc_buf[tx->curr_slc_buf_pos], frames, fc);
+            frames += fc;
         }
         else
-        {        
-            for(uint16_t i=0;i<fc;i++){
-                uint16_t v1 = (uint16_t)(*frames++);
-                uint16_t v2 = (uint16_t)(*frames++);
-                tx->curr_slc_buf[tx->curr_slc_buf_pos++] = (v1 << 16) | v2;
-            }
-        }        
-        
+        {
+            i2s_pack_stereo(&tx->curr_slc_buf[tx->curr_slc_buf_pos], frames, fc);
+            frames += 2 * fc;
+        }
+        tx->curr_slc_buf_pos += fc;
+
         frame_count -= fc;
         frames_written += fc;
     }
@@ -413,23 +504,8 @@ bool i2s_read_sample(int16_t *left, int16_t *right, bool blocking) {
   if (!rx) {
     return false;
   }
-  if (rx->curr_slc_buf_pos==SLC_BUF_LEN || rx->curr_slc_buf==NULL) {
-    if (rx->slc_queue_len == 0) {
-      if (!blocking) {
-        return false;
-      }
-      while (1) {
-        if (rx->slc_queue_len > 0){
-          break;
-        } else {
-          optimistic_yield(10000);
-        }
-      }
-    }
-    ETS_SLC_INTR_DISABLE();
-    rx->curr_slc_buf = (uint32_t *)i2s_slc_queue_next_item(rx);
-    ETS_SLC_INTR_ENABLE();
-    rx->curr_slc_buf_pos=0;
+  if (!_i2s_acquire(rx, blocking)) {
+    return false;
   }
 
   uint32_t sample = rx->curr_slc_buf[rx->curr_slc_buf_pos++];
@@ -443,6 +519,44 @@ bool i2s_read_sample(int16_t *left, int16_t *right, bool blocking) {
   return true;
 }
 
+// Zero-copy access: hand out the rest of the current DMA buffer to be filled (TX) or read (RX)
+// in place, then advance past the words actually used.  The sample API above works on the same
+// buffer, so both can be mixed.
+uint32_t *i2s_tx_acquire(uint16_t *words, bool blocking) {
+  uint16_t n = tx ? _i2s_acquire(tx, blocking) : 0;
+  if (words) {
+    *words = n;
+  }
+  return n ? &tx->curr_slc_buf[tx->curr_slc_buf_pos] : NULL;
+}
+
+void i2s_tx_commit(uint16_t words) {
+  if (tx && tx->curr_slc_buf) {
+    tx->curr_slc_buf_pos = std::min<uint32_t>(tx->curr_slc_buf_pos + words, _i2s_buf_len);
+  }
+}
+
+const uint32_t *i2s_rx_acquire(uint16_t *words, bool blocking) {
+  uint16_t n = rx ? _i2s_acquire(rx, blocking) : 0;
+  if (words) {
+    *words = n;
+  }
+  return n ? &rx->curr_slc_buf[rx->curr_slc_buf_pos] : NULL;
+}
+
+void i2s_rx_release(uint16_t words) {
+  if (rx && rx->curr_slc_buf) {
+    rx->curr_slc_buf_pos = std::min<uint32_t>(rx->curr_slc_buf_pos + words, _i2s_buf_len);
+  }
+}
+
+uint32_t i2s_tx_underruns() {
+  return tx ? tx->xruns : 0;
+}
+
+uint32_t i2s_rx_overruns() {
+  return rx ? rx->xruns : 0;
+}
 
 void i2s_set_rate(uint32_t rate) { //Rate in HZ
   if (rate == _i2s_sample_rate) {
@@ -579,7 +693,7 @@ bool i2s_rxtxdrive_Begin(bool enableRx, bool enableTx, bool driveRxClocks, bool
 
   if (rx) {
     // Need to prime the # of samples to receive in the engine
-    I2SRXEN = SLC_BUF_LEN;
+    I2SRXEN = _i2s_buf_len;
   }
 
   I2SC |= (rx?I2SRXS:0) | (tx?I2STXS:0); // Start transmission/reception
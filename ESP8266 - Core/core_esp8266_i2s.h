@@ -47,6 +47,10 @@ bool i2s_set_bits(int bits); // Set bits per sample, only 16 or 24 supported.  C
 // Note that in 24 bit mode each sample must be left-aligned (i.e. 0x00000000 .. 0xffffff00) as the
 // hardware shifts starting at bit 31, not bit 23.
 
+bool i2s_set_buffers(uint16_t count, uint16_t words); // Set the DMA buffer count (2..255) and length
+// in 32-bit words (1..1023), default 8 x 64.  Call before Begin, or after i2s_end() to resize.
+// More buffers ride out longer stalls (e.g. WiFi), fewer and shorter ones lower the latency.
+
 void i2s_Begin(); // Enable TX only, for compatibility
 bool i2s_rxtx_Begin(bool enableRx, bool enableTx); // Allow TX and/or RX, returns false on OOM error
 bool i2s_rxtxdrive_Begin(bool enableRx, bool enableTx, bool driveRxClocks, bool driveTxClocks);
@@ -66,6 +70,9 @@ uint16_t i2s_available();// returns the number of samples than can be written be
 uint16_t i2s_rx_available();// returns the number of samples than can be written before blocking
 void i2s_set_callback(void (*callback) (void));
 void i2s_rx_set_callback(void (*callback) (void));
+// Called (from the ISR) once each time the number of free TX / filled RX buffers reaches 'buffers'
+void i2s_set_watermark_callback(uint8_t buffers, void (*callback) (void));
+void i2s_rx_set_watermark_callback(uint8_t buffers, void (*callback) (void));
 
 // writes a buffer of frames into the DMA memory, returns the amount of frames written
 // A frame is just a int16_t for mono, for stereo a frame is two int16_t, one for each channel.
@@ -74,6 +81,26 @@ uint16_t i2s_write_buffer_mono_nb(const int16_t *frames, uint16_t frame_count);
 uint16_t i2s_write_buffer(const int16_t *frames, uint16_t frame_count);
 uint16_t i2s_write_buffer_nb(const int16_t *frames, uint16_t frame_count);
 
+// Zero-copy DMA access.  acquire returns the free space left in the current DMA buffer (and its
+// length in 32-bit words) to be filled in place, NULL if none is free and !blocking.  commit
+// hands the first 'words' of it to the DMA, the rest stays available for the next acquire.
+uint32_t *i2s_tx_acquire(uint16_t *words, bool blocking);
+void i2s_tx_commit(uint16_t words);
+// Same for received data: acquire returns the unread part of the current buffer, release
+// consumes 'words' of it.
+const uint32_t *i2s_rx_acquire(uint16_t *words, bool blocking);
+void i2s_rx_release(uint16_t words);
+
+// Packing kernels for filling acquired buffers. mono and stereo produce one 16-bit stereo word
+// per frame like i2s_write_buffer_mono/i2s_write_buffer, 24 produces one left-aligned word per
+// 16-bit sample for 24 bit mode.
+void i2s_pack_mono(uint32_t *dst, const int16_t *src, uint16_t count);
+void i2s_pack_stereo(uint32_t *dst, const int16_t *src, uint16_t count);
+void i2s_pack_24(uint32_t *dst, const int16_t *src, uint16_t count);
+
+uint32_t i2s_tx_underruns(); // DMA buffers played out with no new data since i2s_Begin
+uint32_t i2s_rx_overruns(); // received DMA buffers dropped before being read
+
 #ifdef __cplusplus
 }
 #endif
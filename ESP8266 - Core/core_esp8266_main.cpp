@@ -27,6 +27,7 @@
 
 #include <Arduino.h>
 #include "Schedule.h"
+#include "coredecls.h"
 extern "C" {
 #include "ets_sys.h"
 #include "os_type.h"
@@ -42,6 +43,7 @@ extern "C" {
 #include <umm_malloc/umm_malloc.h>
 #include <core_esp8266_non32xfer.h>
 #include "core_esp8266_vm.h"
+#include "core_esp8266_crashlog.h"
 
 #define LOOP_TASK_PRIORITY 1
 #define LOOP_QUEUE_SIZE    1
@@ -64,6 +66,27 @@ cont_t* g_pcont __attribute__((section(".noinit")));
 /* Event queue used by the main (arduino) task */
 static os_event_t s_loop_queue[LOOP_QUEUE_SIZE];
 
+/* Additional cooperative tasks, each one in its own continuation.
+ * loop_task() resumes the loop() continuation and then every task, in
+ * turn, that was scheduled since it last ran. g_pcont is switched to the
+ * running one, so yield(), esp_suspend() and friends apply to it.
+ */
+struct cont_task_ {
+    cont_task_t* next;
+    cont_t* cont;
+    void (*fn)(void*);
+    void* arg;
+    os_timer_t delay_timer;
+    volatile bool ready;
+    bool done;
+    bool reap;
+};
+
+static cont_t* s_loop_cont;
+static volatile bool s_loop_ready;
+static cont_task_t* s_tasks;
+static cont_task_t* s_task_current;
+
 /* Used to implement optimistic_yield */
 static uint32_t s_cycles_at_resume;
 
@@ -120,7 +143,10 @@ static inline void esp_suspend_within_cont() __attribute__((always_inline));
 static void esp_suspend_within_cont() {
         cont_suspend(g_pcont);
         s_cycles_at_resume = ESP.getCycleCount();
-        run_scheduled_recurrent_functions();
+        // recurrent functions only run from loop(), keeping task stacks small
+        if (!s_task_current) {
+            run_scheduled_recurrent_functions();
+        }
 }
 
 extern "C" void __esp_suspend() {
@@ -131,7 +157,22 @@ extern "C" void __esp_suspend() {
 
 extern "C" void esp_suspend() __attribute__ ((weak, alias("__esp_suspend")));
 
+// From CONT, schedules the calling continuation only. From SYS or an
+// interrupt, the waker can't be told apart, so every continuation is
+// scheduled and waiters recheck their condition on resume.
 extern "C" IRAM_ATTR void esp_schedule() {
+    if (s_task_current && cont_can_suspend(s_task_current->cont)) {
+        s_task_current->ready = true;
+    }
+    else if (!s_task_current && s_loop_cont && cont_can_suspend(s_loop_cont)) {
+        s_loop_ready = true;
+    }
+    else {
+        s_loop_ready = true;
+        for (cont_task_t* task = s_tasks; task; task = task->next) {
+            task->ready = true;
+        }
+    }
     ets_post(LOOP_TASK_PRIORITY, 0, 0);
 }
 
@@ -144,22 +185,31 @@ extern "C" void esp_yield() {
     esp_suspend();
 }
 
+// Only wakes the continuation that armed the delay
 void delay_end(void* arg) {
-    (void)arg;
-    esp_schedule();
+    cont_task_t* task = (cont_task_t*)arg;
+    if (task) {
+        task->ready = true;
+    }
+    else {
+        s_loop_ready = true;
+    }
+    ets_post(LOOP_TASK_PRIORITY, 0, 0);
 }
 
 extern "C" void __esp_delay(unsigned long ms) {
+    cont_task_t* task = s_task_current;
+    os_timer_t* timer = task ? &task->delay_timer : &delay_timer;
     if (ms) {
-        os_timer_setfn(&delay_timer, (os_timer_func_t*)&delay_end, 0);
-        os_timer_arm(&delay_timer, ms, ONCE);
+        os_timer_setfn(timer, (os_timer_func_t*)&delay_end, task);
+        os_timer_arm(timer, ms, ONCE);
     }
     else {
         esp_schedule();
     }
     esp_suspend();
     if (ms) {
-        os_timer_disarm(&delay_timer);
+        os_timer_disarm(timer);
     }
 }
 
@@ -265,14 +315,98 @@ static void loop_wrapper() {
 
 extern "C" void __stack_chk_fail(void);
 
+static void task_wrapper() {
+    s_task_current->fn(s_task_current->arg);
+    s_task_current->done = true;
+}
+
+static void run_tasks() {
+    cont_task_t** link = &s_tasks;
+    while (cont_task_t* task = *link) {
+        if (task->ready && !task->done) {
+            task->ready = false;
+            s_task_current = task;
+            g_pcont = task->cont;
+            s_cycles_at_resume = ESP.getCycleCount();
+            cont_run(task->cont, &task_wrapper);
+            cont_check(task->cont);
+            g_pcont = s_loop_cont;
+            s_task_current = nullptr;
+        }
+        if (task->done && task->reap) {
+            *link = task->next;
+            os_timer_disarm(&task->delay_timer);
+            cont_destroy(task->cont);
+            free(task);
+            continue;
+        }
+        link = &task->next;
+    }
+}
+
 static void loop_task(os_event_t *events) {
     (void) events;
-    s_cycles_at_resume = ESP.getCycleCount();
     ESP.resetHeap();
-    cont_run(g_pcont, &loop_wrapper);
+    if (s_loop_ready) {
+        s_loop_ready = false;
+        s_cycles_at_resume = ESP.getCycleCount();
+        cont_run(g_pcont, &loop_wrapper);
+    }
+    run_tasks();
     ESP.setDramHeap();
 }
 
+cont_task_t* esp_task_create(void (*fn)(void*), void* arg, size_t stack_size) {
+    cont_task_t* task = (cont_task_t*)calloc(1, sizeof(cont_task_t));
+    if (!task) {
+        return nullptr;
+    }
+    task->cont = cont_create(stack_size ? stack_size : CONT_STACKSIZE);
+    if (!task->cont) {
+        free(task);
+        return nullptr;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->ready = true;
+
+    // append, so tasks run in creation order after loop()
+    cont_task_t** link = &s_tasks;
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = task;
+
+    ets_post(LOOP_TASK_PRIORITY, 0, 0);
+    return task;
+}
+
+bool esp_task_done(const cont_task_t* task) {
+    return task->done;
+}
+
+bool esp_task_delete(cont_task_t* task) {
+    if (!task->done) {
+        return false;
+    }
+    // freed by run_tasks(), which may be walking the list right now
+    task->reap = true;
+    ets_post(LOOP_TASK_PRIORITY, 0, 0);
+    return true;
+}
+
+cont_task_t* esp_task_current() {
+    return s_task_current;
+}
+
+int esp_task_get_free_stack(const cont_task_t* task) {
+    return cont_get_free_stack(task ? task->cont : s_loop_cont);
+}
+
+size_t esp_task_get_stack_size(const cont_task_t* task) {
+    return cont_get_stack_size(task ? task->cont : s_loop_cont);
+}
+
 extern "C" {
 struct object { long placeholder[ 10 ]; };
 void __register_frame_info (const void *Begin, struct object *ob);
@@ -649,7 +783,10 @@ extern "C" void user_init(void) {
 
     experimental::initFlashQuirks(); // Chip specific flash init.
 
+    crashlog_boot(); // Move the previous run's crash record to flash
+
     cont_init(g_pcont);
+    s_loop_cont = g_pcont;
 
 #if defined(DEBUG_ESP_HWDT) || defined(DEBUG_ESP_HWDT_NOEXTRA4K)
     debug_hwdt_init();
@@ -27,11 +27,104 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <math.h>
-#include <limits>
 #include "stdlib_noniso.h"
 
+/*
+    dtostrf() works on the exact binary value of the double: it is split
+    into an integer mantissa and a power of two, and the digits come out of
+    integer arithmetic, rounded half to even like printf("%.*f"). Values
+    with a 64 bit integer part and at most 60 fractional bits, which covers
+    every float widened to double in the usual ranges, take a uint64_t fast
+    path; the others go through a small multiword one.
+*/
+
+namespace {
+
+constexpr uint32_t chunkBase = 1000000000;
+// 2^1024 has 309 digits, in chunks of 9
+constexpr int maxChunks = 35;
+// Up to 1074 fractional bits, or 1024 integer ones
+constexpr int maxWords = 35;
+
+// Integer part of m * 2^e, in base 1e9 chunks, least significant first
+int big_int_chunks(uint64_t m, int e, uint32_t* chunks) {
+    uint32_t words[maxWords] = {};
+    const int lo = e / 32;
+    const int sh = e % 32;
+    words[lo] = (uint32_t)m << sh;
+    words[lo + 1] = (uint32_t)(m >> (32 - sh));
+    words[lo + 2] = sh ? (uint32_t)(m >> (64 - sh)) : 0;
+
+    int nw = lo + 3;
+    int n = 0;
+    while (nw && !words[nw - 1]) {
+        nw--;
+    }
+    while (nw) {
+        uint64_t rem = 0;
+        for (int i = nw - 1; i >= 0; i--) {
+            uint64_t cur = (rem << 32) | words[i];
+            words[i] = cur / chunkBase;
+            rem = cur % chunkBase;
+        }
+        chunks[n++] = rem;
+        while (nw && !words[nw - 1]) {
+            nw--;
+        }
+    }
+    return n;
+}
+
+char* put_chunks(char* out, const uint32_t* chunks, int n) {
+    char tmp[10];
+    int len = 0;
+    uint32_t v = chunks[n - 1];
+    do {
+        tmp[len++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (len) {
+        *out++ = tmp[--len];
+    }
+    for (int i = n - 2; i >= 0; i--) {
+        v = chunks[i];
+        for (int j = 8; j >= 0; j--) {
+            out[j] = '0' + v % 10;
+            v /= 10;
+        }
+        out += 9;
+    }
+    return out;
+}
+
+} // namespace
+
 extern "C" {
 
+// Same contract as the newlib ones they replace: lower case digits, base 2
+// to 36, and a sign only in base 10
+char* utoa(unsigned int value, char* result, int base) {
+    if (base < 2 || base > 36) {
+        *result = 0;
+        return NULL;
+    }
+    char buf[8 * sizeof(value)];
+    char* end = buf + sizeof(buf);
+    char* digits = utoa_backwards(value, end, base, false);
+    memcpy(result, digits, end - digits);
+    result[end - digits] = 0;
+    return result;
+}
+
+char* itoa(int value, char* result, int base) {
+    if (base == 10 && value < 0) {
+        *result = '-';
+        utoa(-(unsigned int)value, result + 1, base);
+        return result;
+    }
+    return utoa((unsigned int)value, result, base);
+}
+
 char* ltoa(long value, char* result, int base) {
     return itoa((int)value, result, base);
 }
@@ -41,8 +134,6 @@ char* ultoa(unsigned long value, char* result, int base) {
 }
 
 char * dtostrf(double number, signed char width, unsigned char prec, char *s) {
-    bool negative = false;
-
     if (isnan(number)) {
         strcpy(s, "nan");
         return s;
@@ -52,68 +143,142 @@ char * dtostrf(double number, signed char width, unsigned char prec, char *s) {
         return s;
     }
 
-    char* out = s;
-
-    int fillme = width; // how many cells to fill for the integer part
-    if (prec > 0) {
-        fillme -= (prec+1);
+    const bool negative = number < 0.0;
+    if (negative) {
+        number = -number;
     }
 
-    // Handle negative numbers
-    if (number < 0.0) {
-        negative = true;
-        fillme--;
-        number = -number;
+    // number == m * 2^e
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    uint64_t m = bits & ((1ULL << 52) - 1);
+    int e = (bits >> 52) & 0x7ff;
+    if (e) {
+        m |= 1ULL << 52;
+    } else {
+        e = 1;
+    }
+    e -= 1075;
+    if (!m) {
+        e = 0;
+    }
+    else if (e < 0) {
+        // drop the trailing zero bits, widened floats then have a short mantissa
+        int tz = __builtin_ctzll(m);
+        if (tz > -e) {
+            tz = -e;
+        }
+        m >>= tz;
+        e += tz;
     }
+    const int k = (e < 0) ? -e : 0;
 
-    // Round correctly so that print(1.999, 2) prints as "2.00"
-    // I optimized out most of the divisions
-    double rounding = 2.0;
-    for (uint8_t i = 0; i < prec; ++i)
-        rounding *= 10.0;
-    rounding = 1.0 / rounding;
+    // Digits first, behind one spare cell for a carry out of the rounding
+    char* out = s;
+    *out++ = '0';
 
-    number += rounding;
+    uint32_t chunks[maxChunks];
+    int nchunks = 0;
+    if (e > 11) {
+        nchunks = big_int_chunks(m, e, chunks);
+    }
+    else {
+        uint64_t ipart = (e >= 0) ? (m << e) : ((k < 64) ? (m >> k) : 0);
+        do {
+            chunks[nchunks++] = ipart % chunkBase;
+            ipart /= chunkBase;
+        } while (ipart);
+    }
+    out = put_chunks(out, chunks, nchunks);
+    int intdigits = out - s - 1;
 
-    // Figure out how big our number really is
-    double tenpow = 1.0;
-    int digitcount = 1;
-    double nextpow;
-    while (number >= (nextpow = (10.0 * tenpow))) {
-        tenpow = nextpow;
-        digitcount++;
+    bool up = false;
+    if (!k) {
+        memset(out, '0', prec);
+        out += prec;
     }
+    else if (k <= 60) {
+        const uint64_t mask = (1ULL << k) - 1;
+        uint64_t f = m & mask;
+        for (uint8_t i = 0; i < prec; ++i) {
+            f *= 10;
+            *out++ = '0' + (f >> k);
+            f &= mask;
+        }
+        const uint64_t half = 1ULL << (k - 1);
+        up = (f > half) || ((f == half) && ((out[-1] - '0') & 1));
+    }
+    else {
+        // the fraction is all of m, scaled to a whole number of words
+        uint32_t words[maxWords] = {};
+        const int nw = (k + 31) / 32;
+        const int sh = nw * 32 - k;
+        words[0] = (uint32_t)m << sh;
+        words[1] = (uint32_t)(m >> (32 - sh));
+        words[2] = sh ? (uint32_t)(m >> (64 - sh)) : 0;
 
-    // minimal compensation for possible lack of precision (#7087 addition)
-    number *= 1 + std::numeric_limits<decltype(number)>::epsilon();
+        int lo = 0;
+        for (uint8_t i = 0; i < prec; ++i) {
+            uint32_t carry = 0;
+            for (int w = lo; w < nw; w++) {
+                uint64_t v = (uint64_t)words[w] * 10 + carry;
+                words[w] = (uint32_t)v;
+                carry = v >> 32;
+            }
+            *out++ = '0' + carry;
+            while (lo < nw && !words[lo]) {
+                lo++;
+            }
+        }
+        const uint32_t top = words[nw - 1];
+        const bool rest = lo < nw - 1;
+        up = (top > 0x80000000) || ((top == 0x80000000) && (rest || ((out[-1] - '0') & 1)));
+    }
 
-    number /= tenpow;
-    fillme -= digitcount;
+    if (up) {
+        // the spare cell stops the carry at worst
+        char* p = out;
+        while (*--p == '9') {
+            *p = '0';
+        }
+        (*p)++;
+    }
 
-    // Pad unused cells with spaces
-    while (fillme-- > 0) {
-        *out++ = ' ';
+    char* digits = s + 1;
+    if (s[0] != '0') {
+        digits = s;
+        intdigits++;
     }
 
-    // Handle negative sign
-    if (negative) *out++ = '-';
+    int fillme = width - intdigits - negative; // how many cells to pad
+    if (prec > 0) {
+        fillme -= (prec+1);
+    }
+    if (fillme < 0) {
+        fillme = 0;
+    }
 
-    // Print the digits, and if necessary, the decimal point
-    digitcount += prec;
-    int8_t digit = 0;
-    while (digitcount-- > 0) {
-        digit = (int8_t)number;
-        if (digit > 9) digit = 9; // insurance
-        *out++ = (char)('0' | digit);
-        if ((digitcount == prec) && (prec > 0)) {
-            *out++ = '.';
-        }
-        number -= digit;
-        number *= 10.0;
+    // Move the digits in place, fraction first as it never overlaps the
+    // integer part on its way right
+    char* dst = s + fillme + negative;
+    if (prec > 0) {
+        memmove(dst + intdigits + 1, digits + intdigits, prec);
+    }
+    memmove(dst, digits, intdigits);
+    out = dst + intdigits;
+    if (prec > 0) {
+        *out = '.';
+        out += prec + 1;
     }
 
     // make sure the string is terminated
     *out = 0;
+
+    // Pad unused cells with spaces, and the sign
+    memset(s, ' ', fillme);
+    if (negative) {
+        s[fillme] = '-';
+    }
     return s;
 }
 
@@ -33,6 +33,7 @@
 #include "gdb_hooks.h"
 #include "StackThunk.h"
 #include "coredecls.h"
+#include "core_esp8266_crashlog.h"
 
 extern "C" {
 
@@ -147,6 +148,17 @@ static void postmortem_report(uint32_t sp_dump) {
 
     ets_install_putc1(&uart_write_char_d);
 
+    // Kept in RTC memory for crashlog_boot(), the UART is rarely watched in the field
+    crashlog_record_t crash;
+    memset(&crash, 0, sizeof(crash));
+    crash.reason = rst_info.reason;
+    crash.exccause = rst_info.exccause;
+    crash.epc1 = rst_info.epc1;
+    crash.epc2 = rst_info.epc2;
+    crash.epc3 = rst_info.epc3;
+    crash.excvaddr = rst_info.excvaddr;
+    crash.depc = rst_info.depc;
+
     cut_here();
 
     if (s_panic_line) {
@@ -179,6 +191,8 @@ static void postmortem_report(uint32_t sp_dump) {
         }
         ets_printf_P(PSTR("\nException (%d):\nepc1=0x%08x epc2=0x%08x epc3=0x%08x excvaddr=0x%08x depc=0x%08x\n"),
             exccause, epc1, rst_info.epc2, rst_info.epc3, rst_info.excvaddr, rst_info.depc);
+        crash.exccause = exccause;
+        crash.epc1 = epc1;
     }
     else if (rst_info.reason == REASON_SOFT_WDT_RST) {
         ets_printf_P(PSTR("\nSoft WDT reset\n"));
@@ -189,6 +203,8 @@ static void postmortem_report(uint32_t sp_dump) {
         ets_printf_P(PSTR("\nStack smashing detected.\n"));
         ets_printf_P(PSTR("\nException (%d):\nepc1=0x%08x epc2=0x%08x epc3=0x%08x excvaddr=0x%08x depc=0x%08x\n"),
             5 /* Alloca exception, closest thing to stack fault*/, s_stacksmash_addr, 0, 0, 0, 0);
+        crash.exccause = 5;
+        crash.epc1 = s_stacksmash_addr;
    }
     else {
         ets_printf_P(PSTR("\nGeneric Reset\n"));
@@ -233,6 +249,7 @@ static void postmortem_report(uint32_t sp_dump) {
         // BearSSL we dump the BSSL second stack and then reset SP back to the main cont stack
         ets_printf_P(PSTR("\nctx: bearssl\nsp: %08x end: %08x offset: %04x\n"), sp_dump, stack_thunk_get_stack_top(), offset);
         print_stack(sp_dump + offset, stack_thunk_get_stack_top());
+        crashlog_add_trace(&crash, sp_dump + offset, stack_thunk_get_stack_top());
         offset = 0; // No offset needed anymore, the exception info was stored in the bssl stack
         sp_dump = stack_thunk_get_cont_sp();
     }
@@ -251,9 +268,19 @@ static void postmortem_report(uint32_t sp_dump) {
     ets_printf_P(PSTR("sp: %08x end: %08x offset: %04x\n"), sp_dump, stack_end, offset);
 
     print_stack(sp_dump + offset, stack_end);
+    crashlog_add_trace(&crash, sp_dump + offset, stack_end);
 
     ets_printf_P(PSTR("<<<stack<<<\n"));
 
+    crash.sp = sp_dump;
+    crash.uptime_ms = millis();
+    crash.free_heap = system_get_free_heap_size();
+    crash.cont_free_stack = cont_get_free_stack(g_pcont);
+    crash.thunk_peak = stack_thunk_get_peak_usage();
+    if (crash.reason != REASON_DEFAULT_RST) {
+        crashlog_save(&crash);
+    }
+
     // Use cap-X formatting to ensure the standard EspExceptionDecoder doesn't match the address
     if (umm_last_fail_alloc_addr) {
 #if defined(DEBUG_ESP_OOM)
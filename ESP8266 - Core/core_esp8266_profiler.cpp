@@ -0,0 +1,159 @@
+/*
+ core_esp8266_profiler.cpp - sampling profiler on the timer1 NMI
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "Arduino.h"
+#include "Print.h"
+#include "core_esp8266_waveform.h"
+#include "core_esp8266_profiler.h"
+
+static_assert((PROFILER_SLOTS & (PROFILER_SLOTS - 1)) == 0, "PROFILER_SLOTS must be a power of 2");
+
+// Linear probing stops after this many slots, the sample is dropped then
+#define PROFILER_PROBES 8
+
+typedef struct {
+    uint32_t pc;
+    uint32_t count;
+} profiler_slot_t;
+
+static profiler_slot_t* s_table = NULL;
+static volatile bool s_running = false;
+static uint32_t s_interval;             // CPU cycles between samples
+static uint32_t s_next;                 // cycle count of the next sample
+static volatile uint32_t s_samples;
+static volatile uint32_t s_dropped;
+static volatile uint32_t s_used;
+
+// Called from the waveform NMI on each of its events, only samples when due
+static IRAM_ATTR uint32_t profiler_sample() {
+    const uint32_t now = ESP.getCycleCount();
+    const int32_t left = s_next - now;
+    if (left > 0) {
+        return left;
+    }
+    if (!s_running) {
+        return s_interval;
+    }
+
+    uint32_t pc;
+    __asm__ __volatile__("rsr.epc3 %0" : "=a"(pc));
+
+    uint32_t idx = ((pc >> 2) * 2654435761u) & (PROFILER_SLOTS - 1);
+    for (int probe = 0; probe < PROFILER_PROBES; probe++) {
+        profiler_slot_t* slot = &s_table[idx];
+        if (slot->pc == pc) {
+            slot->count++;
+            break;
+        }
+        if (!slot->pc) {
+            slot->pc = pc;
+            slot->count = 1;
+            s_used++;
+            break;
+        }
+        if (probe == PROFILER_PROBES - 1) {
+            s_dropped++;
+        }
+        idx = (idx + 1) & (PROFILER_SLOTS - 1);
+    }
+    s_samples++;
+
+    // Don't try to catch up after a long masked stretch, just resume
+    s_next += s_interval;
+    if ((int32_t)(s_next - now) <= 0) {
+        s_next = now + s_interval;
+    }
+    return s_next - now;
+}
+
+extern "C" {
+
+bool profiler_start(uint32_t rate_hz) {
+    if (!rate_hz || rate_hz > 100000) {
+        return false;
+    }
+    profiler_end();
+    s_table = (profiler_slot_t*)calloc(PROFILER_SLOTS, sizeof(profiler_slot_t));
+    if (!s_table) {
+        return false;
+    }
+    s_samples = 0;
+    s_dropped = 0;
+    s_used = 0;
+    s_interval = ESP.getCpuFreqMHz() * (1000000 / rate_hz);
+    s_next = ESP.getCycleCount() + s_interval;
+    s_running = true;
+    setTimer1Callback(profiler_sample);
+    return true;
+}
+
+void profiler_stop(void) {
+    if (s_running) {
+        s_running = false;
+        setTimer1Callback(NULL);
+    }
+}
+
+void profiler_end(void) {
+    profiler_stop();
+    free(s_table);
+    s_table = NULL;
+}
+
+bool profiler_running(void) {
+    return s_running;
+}
+
+void profiler_get_stats(profiler_stats_t* stats) {
+    stats->samples = s_samples;
+    stats->dropped = s_dropped;
+    stats->used = s_used;
+}
+
+};
+
+size_t profiler_dump(PrintClass& out) {
+    if (!s_table) {
+        return 0;
+    }
+    // Sort a copy, the NMI may still be counting into the table
+    profiler_slot_t* slots = (profiler_slot_t*)malloc(PROFILER_SLOTS * sizeof(profiler_slot_t));
+    if (!slots) {
+        return 0;
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < PROFILER_SLOTS; i++) {
+        if (s_table[i].pc) {
+            slots[used++] = s_table[i];
+        }
+    }
+    qsort(slots, used, sizeof(profiler_slot_t), [](const void* a, const void* b) {
+        const uint32_t ca = ((const profiler_slot_t*)a)->count;
+        const uint32_t cb = ((const profiler_slot_t*)b)->count;
+        return (ca < cb) - (ca > cb);
+    });
+
+    size_t n = out.Printf_P(PSTR("# samples %u dropped %u\n"), s_samples, s_dropped);
+    for (size_t i = 0; i < used; i++) {
+        n += out.Printf_P(PSTR("0x%08x %u\n"), slots[i].pc, slots[i].count);
+    }
+    free(slots);
+    return n;
+}
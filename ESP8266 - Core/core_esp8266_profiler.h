@@ -0,0 +1,69 @@
+/*
+ core_esp8266_profiler.h - sampling profiler on the timer1 NMI
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+   The interrupted PC (EPC3) is sampled from the waveform generator's
+   timer1 NMI through setTimer1Callback(), so code running with interrupts
+   disabled is seen too, and counted in a small hash table in RAM. Nothing
+   else may use setTimer1Callback() while profiling.
+
+   profiler_dump() prints one "0xPC count" line per address, most hit first,
+   after a "# samples" header. The addresses can be passed as is to
+   xtensa-lx106-elf-addr2line -f -e sketch.elf and summed per function.
+*/
+
+#ifndef CORE_ESP8266_PROFILER_H
+#define CORE_ESP8266_PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef PROFILER_SLOTS
+#define PROFILER_SLOTS 512      // distinct PCs, 8 bytes each
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t samples;       // taken since profiler_start()
+    uint32_t dropped;       // PCs that didn't fit in the table
+    uint32_t used;          // table entries in use
+} profiler_stats_t;
+
+// Allocates the table and starts sampling rate_hz times a second
+bool profiler_start(uint32_t rate_hz);
+// Stops sampling, the table stays around for profiler_dump()
+void profiler_stop(void);
+// Frees the table
+void profiler_end(void);
+bool profiler_running(void);
+void profiler_get_stats(profiler_stats_t* stats);
+
+#ifdef __cplusplus
+}
+
+class PrintClass;
+
+// Works with Serial as well as with a File
+size_t profiler_dump(PrintClass& out);
+#endif
+
+#endif // CORE_ESP8266_PROFILER_H
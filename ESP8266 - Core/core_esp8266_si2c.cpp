@@ -23,6 +23,7 @@
 #include "pins_arduino.h"
 #include "wiring_private.h"
 #include "PolledTimeOut.h"
+#include "Schedule.h"
 
 extern "C"
 {
@@ -62,7 +63,8 @@ class Twi
 {
 private:
     unsigned int  preferred_si2c_clock  = 100000;
-    uint32_t      twi_dcount            = 18;
+    uint32_t      twi_halfCycles        = F_CPU / 200000;  // half SCL period in CPU cycles
+    uint32_t      twi_edge              = 0;               // cycle count of the next SCL edge
     unsigned char twi_sda               = 0;
     unsigned char twi_scl               = 0;
     unsigned char twi_addr              = 0;
@@ -144,12 +146,33 @@ private:
     // Allow not linking in the slave code if there is no call to setAddress
     bool _slaveEnabled = false;
 
+    // Transaction queue, the head is the one on the bus
+    twi_transaction_t* q_head      = nullptr;
+    twi_transaction_t* q_tail      = nullptr;
+    unsigned int       q_segment   = 0;      // segment of q_head in progress
+    unsigned int       q_pos       = 0;      // next data byte of that segment
+    bool               q_addressed = false;  // START and address sent for that segment
+    bool               q_scheduled = false;
+    // Set while something drives the bus. WAIT_CLOCK_STRETCH() yields, which runs queueSlice(),
+    // and that must not start stepping in the middle of another transfer.
+    bool q_busy = false;
+
+    class BusyScope
+    {
+    public:
+        explicit BusyScope(Twi& twi) : _twi(twi), _prev(twi.q_busy) { _twi.q_busy = true; }
+        ~BusyScope() { _twi.q_busy = _prev; }
+
+    protected:
+        Twi& _twi;
+        bool _prev;
+    };
+
     // Internal use functions
-    void IRAM_ATTR busywait(unsigned int v);
     bool           write_start(void);
     bool           write_stop(void);
-    bool           write_bit(bool bit);
-    bool           read_bit(void);
+    inline bool    write_bit(bool bit) __attribute__((always_inline));
+    inline bool    read_bit(void) __attribute__((always_inline));
     bool           write_byte(unsigned char byte);
     unsigned char  read_byte(bool nack);
     void IRAM_ATTR onTwipEvent(uint8_t status);
@@ -169,9 +192,50 @@ private:
         }
     }
 
+    // Edges are timed against the cycle counter instead of counted nop loops, so code between
+    // edges (and flash cache misses) eats into the half period instead of stretching it.
+    // edge_sync() arms the first edge a full half period ahead, the line state just set up
+    // gets its whole phase.
+    inline __attribute__((always_inline)) void edge_sync()
+    {
+        twi_edge = esp_get_cycle_count() + twi_halfCycles;
+    }
+
+    inline __attribute__((always_inline)) void wait_edge()
+    {
+        // Callers change a pin just before, so always leave that pin at least half a half
+        // period. If something held us up, restart the timing from there rather than catching
+        // up with shortened phases.
+        uint32_t now = esp_get_cycle_count();
+        if ((int32_t)(twi_edge - now) < (int32_t)(twi_halfCycles >> 1))
+        {
+            twi_edge = now + (twi_halfCycles >> 1);
+        }
+        while ((int32_t)(esp_get_cycle_count() - twi_edge) < 0)
+        {
+        }
+        twi_edge += twi_halfCycles;
+    }
+
+    // Common case is a single register read, the polled timeout is only set up if the slave
+    // actually stretches the clock
+    inline __attribute__((always_inline)) void wait_scl_high()
+    {
+        if (!SCL_READ(twi_scl))
+        {
+            WAIT_CLOCK_STRETCH();
+            twi_edge = esp_get_cycle_count() + twi_halfCycles;
+        }
+    }
+
     // Generate a clock "valley" (at the end of a segment, just before a repeated start)
     void twi_scl_valley(void);
 
+    // Clock one byte of the queued transaction, and finish the segment after its last byte
+    void queueStep(void);
+    bool queueSlice(void);
+    void queueFinishCurrent(void);
+
 public:
     void           setClock(unsigned int freq);
     void           setClockStretchLimit(uint32_t limit);
@@ -182,6 +246,8 @@ public:
     unsigned char  readFrom(unsigned char address, unsigned char* buf, unsigned int len,
                             unsigned char sendStop);
     uint8_t        status();
+    bool           queue(twi_transaction_t* transaction);
+    size_t         queuePending(void);
     uint8_t        transmit(const uint8_t* data, uint8_t length);
     void           attachSlaveRxEvent(void (*function)(uint8_t*, size_t));
     void           attachSlaveTxEvent(void (*function)(void));
@@ -205,27 +271,21 @@ void Twi::setClock(unsigned int freq)
 
     preferred_si2c_clock = freq;
 
+    // edges are timed with the cycle counter, these limits keep the per-edge work
+    // within a half period
 #if F_CPU == FCPU80
-
-    if (freq > 400000)
+    if (freq > 500000)
     {
-        freq = 400000;
+        freq = 500000;
     }
-    twi_dcount = (500000000 / freq);  // half-cycle period in ns
-    twi_dcount
-        = (1000 * (twi_dcount - 1120)) / 62500;  // (half cycle - overhead) / busywait loop time
-
 #else
-
-    if (freq > 800000)
+    if (freq > 1000000)
     {
-        freq = 800000;
+        freq = 1000000;
     }
-    twi_dcount = (500000000 / freq);  // half-cycle period in ns
-    twi_dcount
-        = (1000 * (twi_dcount - 560)) / 31250;  // (half cycle - overhead) / busywait loop time
-
 #endif
+
+    twi_halfCycles = F_CPU / (2 * freq);
 }
 
 void Twi::setClockStretchLimit(uint32_t limit)
@@ -265,16 +325,6 @@ void Twi::enableSlave()
     }
 }
 
-void IRAM_ATTR Twi::busywait(unsigned int v)
-{
-    unsigned int i;
-    for (i = 0; i < v; i++)  // loop time is 5 machine cycles: 31.25ns @ 160MHz, 62.5ns @ 80MHz
-    {
-        __asm__ __volatile__(
-            "nop");  // minimum element to keep GCC from optimizing this function out.
-    }
-}
-
 bool Twi::write_start(void)
 {
     SCL_HIGH(twi_scl);
@@ -283,14 +333,16 @@ bool Twi::write_start(void)
     {
         return false;
     }
-    busywait(twi_dcount);
+    edge_sync();
+    wait_edge();
+    wait_edge();
     // A high-to-low transition on the SDA line while the SCL is high defines a START condition.
     SDA_LOW(twi_sda);
-    busywait(twi_dcount);
+    wait_edge();
     // An additional delay between the SCL line high-to-low transition and setting up the SDA line
     // to prevent a STOP condition execute.
     SCL_LOW(twi_scl);
-    busywait(twi_dcount);
+    wait_edge();
     return true;
 }
 
@@ -298,17 +350,17 @@ bool Twi::write_stop(void)
 {
     SCL_LOW(twi_scl);
     SDA_LOW(twi_sda);
-    busywait(twi_dcount);
+    wait_edge();
     SCL_HIGH(twi_scl);
-    WAIT_CLOCK_STRETCH();
-    busywait(twi_dcount);
+    wait_scl_high();
+    wait_edge();
     // A low-to-high transition on the SDA line while the SCL is high defines a STOP condition.
     SDA_HIGH(twi_sda);
-    busywait(twi_dcount);
+    wait_edge();
     return true;
 }
 
-bool Twi::write_bit(bool bit)
+inline bool Twi::write_bit(bool bit)
 {
     SCL_LOW(twi_scl);
     if (bit)
@@ -319,32 +371,31 @@ bool Twi::write_bit(bool bit)
     {
         SDA_LOW(twi_sda);
     }
-    busywait(twi_dcount + 1);
+    wait_edge();
     SCL_HIGH(twi_scl);
-    WAIT_CLOCK_STRETCH();
-    busywait(twi_dcount);
+    wait_scl_high();
+    wait_edge();
     return true;
 }
 
-bool Twi::read_bit(void)
+inline bool Twi::read_bit(void)
 {
     SCL_LOW(twi_scl);
     SDA_HIGH(twi_sda);
-    busywait(twi_dcount + 2);
+    wait_edge();
     SCL_HIGH(twi_scl);
-    WAIT_CLOCK_STRETCH();
+    wait_scl_high();
     bool bit = SDA_READ(twi_sda);
-    busywait(twi_dcount);
+    wait_edge();
     return bit;
 }
 
 bool Twi::write_byte(unsigned char byte)
 {
-    unsigned char bit;
-    for (bit = 0; bit < 8; bit++)
+#pragma GCC unroll 8
+    for (int bit = 7; bit >= 0; bit--)
     {
-        write_bit(byte & 0x80);
-        byte <<= 1;
+        write_bit(byte & (1 << bit));
     }
     return !read_bit();  // NACK/ACK
 }
@@ -352,8 +403,8 @@ bool Twi::write_byte(unsigned char byte)
 unsigned char Twi::read_byte(bool nack)
 {
     unsigned char byte = 0;
-    unsigned char bit;
-    for (bit = 0; bit < 8; bit++)
+#pragma GCC unroll 8
+    for (int bit = 0; bit < 8; bit++)
     {
         byte = (byte << 1) | read_bit();
     }
@@ -365,6 +416,8 @@ unsigned char Twi::writeTo(unsigned char address, unsigned char* buf, unsigned i
                            unsigned char sendStop)
 {
     unsigned int i;
+    BusyScope    busy(*this);
+    queueFinishCurrent();
     if (!write_start())
     {
         return 4;  // line busy
@@ -395,14 +448,14 @@ unsigned char Twi::writeTo(unsigned char address, unsigned char* buf, unsigned i
     else
     {
         twi_scl_valley();
-        // TD-er: Also busywait(twi_dcount) here?
-        // busywait(twi_dcount);
+        // TD-er: Also wait_edge() here?
+        // wait_edge();
     }
     i = 0;
     while (!SDA_READ(twi_sda) && (i++) < 10)
     {
         twi_scl_valley();
-        busywait(twi_dcount);
+        wait_edge();
     }
     return 0;
 }
@@ -411,6 +464,8 @@ unsigned char Twi::readFrom(unsigned char address, unsigned char* buf, unsigned
                             unsigned char sendStop)
 {
     unsigned int i;
+    BusyScope    busy(*this);
+    queueFinishCurrent();
     if (!write_start())
     {
         return 4;  // line busy
@@ -435,14 +490,14 @@ unsigned char Twi::readFrom(unsigned char address, unsigned char* buf, unsigned
     else
     {
         twi_scl_valley();
-        // TD-er: Also busywait(twi_dcount) here?
-        // busywait(twi_dcount);
+        // TD-er: Also wait_edge() here?
+        // wait_edge();
     }
     i = 0;
     while (!SDA_READ(twi_sda) && (i++) < 10)
     {
         twi_scl_valley();
-        busywait(twi_dcount);
+        wait_edge();
     }
     return 0;
 }
@@ -450,9 +505,168 @@ unsigned char Twi::readFrom(unsigned char address, unsigned char* buf, unsigned
 void Twi::twi_scl_valley(void)
 {
     SCL_LOW(twi_scl);
-    busywait(twi_dcount);
+    wait_edge();
     SCL_HIGH(twi_scl);
-    WAIT_CLOCK_STRETCH();
+    wait_scl_high();
+}
+
+bool Twi::queue(twi_transaction_t* transaction)
+{
+    if (!transaction || !transaction->count)
+    {
+        return false;
+    }
+    if (!q_scheduled)
+    {
+        q_scheduled = schedule_recurrent_function_us([]() { return twi.queueSlice(); }, 0);
+        if (!q_scheduled)
+        {
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < transaction->count; i++)
+    {
+        transaction->segments[i].status = TWI_PENDING;
+    }
+    transaction->next = nullptr;
+    if (q_tail)
+    {
+        q_tail->next = transaction;
+    }
+    else
+    {
+        q_head = transaction;
+    }
+    q_tail = transaction;
+    return true;
+}
+
+size_t Twi::queuePending(void)
+{
+    size_t n = 0;
+    for (twi_transaction_t* t = q_head; t; t = t->next)
+    {
+        n++;
+    }
+    return n;
+}
+
+// The bus may sit between slices for as long as the scheduler takes to come back.  SCL is left
+// high with SDA unchanged after each byte, so the pause is neither a START nor a STOP. The timing
+// is re-armed a half period ahead on resuming, so the first SCL low still gets its full length.
+bool Twi::queueSlice(void)
+{
+    if (q_busy)
+    {
+        // try again on the next round
+        return true;
+    }
+    BusyScope busy(*this);
+    twi_edge = esp_get_cycle_count() + twi_halfCycles;
+    for (int n = TWI_QUEUE_SLICE_BYTES; q_head && n > 0; n--)
+    {
+        queueStep();
+    }
+    q_scheduled = q_head != nullptr;
+    return q_scheduled;
+}
+
+// The synchronous calls cannot be interleaved with a half-done transaction, run it to its end
+void Twi::queueFinishCurrent(void)
+{
+    if (!q_head || (!q_addressed && !q_segment))
+    {
+        return;
+    }
+    BusyScope busy(*this);
+    // resuming after a gap, see queueSlice()
+    twi_edge = esp_get_cycle_count() + twi_halfCycles;
+    twi_transaction_t* t = q_head;
+    while (q_head == t)
+    {
+        queueStep();
+    }
+}
+
+void Twi::queueStep(void)
+{
+    twi_transaction_t* t      = q_head;
+    twi_segment_t*     seg    = &t->segments[q_segment];
+    uint8_t            result = 0;
+
+    if (!q_addressed)
+    {
+        if (!write_start())
+        {
+            result = 4;  // line busy
+        }
+        else if (!write_byte(((seg->address << 1) | (seg->read ? 1 : 0)) & 0xFF))
+        {
+            result = 2;  // received NACK on transmit of address
+        }
+        else
+        {
+            q_addressed = true;
+            q_pos       = 0;
+            if (seg->len)
+            {
+                return;
+            }
+        }
+    }
+    else if (seg->read)
+    {
+        seg->buf[q_pos] = read_byte(q_pos + 1 == seg->len);
+        if (++q_pos < seg->len)
+        {
+            return;
+        }
+    }
+    else if (!write_byte(seg->buf[q_pos]))
+    {
+        result = 3;  // received NACK on transmit of data
+    }
+    else if (++q_pos < seg->len)
+    {
+        return;
+    }
+
+    // end of segment, a failure always releases the bus since the rest of the transaction is
+    // abandoned
+    seg->status = result;
+    if (result != 4)
+    {
+        if (seg->stop || result)
+        {
+            write_stop();
+        }
+        else
+        {
+            twi_scl_valley();
+        }
+        unsigned int i = 0;
+        while (!SDA_READ(twi_sda) && (i++) < 10)
+        {
+            twi_scl_valley();
+            wait_edge();
+        }
+    }
+    q_addressed = false;
+
+    if (!result && ++q_segment < t->count)
+    {
+        return;
+    }
+    q_segment = 0;
+    q_head    = t->next;
+    if (!q_head)
+    {
+        q_tail = nullptr;
+    }
+    if (t->done)
+    {
+        t->done(t, result);
+    }
 }
 
 uint8_t Twi::status()
@@ -465,6 +679,7 @@ uint8_t Twi::status()
     }
 
     int clockCount = 20;
+    edge_sync();
     while (!SDA_READ(twi_sda)
            && clockCount-- > 0)  // if SDA low, read the bits slaves have to sent to a max
     {
@@ -1044,6 +1259,16 @@ extern "C"
         return twi.status();
     }
 
+    bool twi_queue(twi_transaction_t* transaction)
+    {
+        return twi.queue(transaction);
+    }
+
+    size_t twi_queuePending(void)
+    {
+        return twi.queuePending();
+    }
+
     uint8_t twi_transmit(const uint8_t* buf, uint8_t len)
     {
         return twi.transmit(buf, len);
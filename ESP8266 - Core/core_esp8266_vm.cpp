@@ -42,6 +42,17 @@
  to go out over the (slow) SPI bus.  The SPI is set up in a DIO mode which
  uses no more pins than normal SPI, but provides for ~2X faster transfers.
 
+ The cache geometry can be tuned at build time:
+   MMU_EXTERNAL_HEAP_CACHE_WAYS       ways per set (default 4)
+   MMU_EXTERNAL_HEAP_CACHE_SETS       sets, power of 2 (default 1, fully associative)
+   MMU_EXTERNAL_HEAP_CACHE_LINE_WORDS words per line, lines longer than the
+                                      16 word SPI buffer are filled in several
+                                      transactions (default 16)
+   MMU_EXTERNAL_HEAP_PREFETCH         fetch the next line in the background on
+                                      sequential misses (default 1)
+ Large buffers are better moved with vm_memcpy()/vm_memset(), which talk to
+ the SPI RAM directly in 64 byte blocks.
+
  NOTE: This works fine for processor accesses, but cannot be used by any
  of the peripherals' DMA.  For that, we'd need a real MMU.
 
@@ -144,23 +155,53 @@ typedef enum { sio = 0, dio = 1 } iotype;
 
 constexpr int read_delay = (hspi_mode == dio) ? 4-1 : 0;
 
-constexpr int cache_ways = 4;   // N-way, fully associative cache
-constexpr int cache_words = 16; // Must be 16 words or smaller to fit in SPI buffer
+#ifndef MMU_EXTERNAL_HEAP_CACHE_WAYS
+#define MMU_EXTERNAL_HEAP_CACHE_WAYS 4
+#endif
+#ifndef MMU_EXTERNAL_HEAP_CACHE_SETS
+#define MMU_EXTERNAL_HEAP_CACHE_SETS 1
+#endif
+#ifndef MMU_EXTERNAL_HEAP_CACHE_LINE_WORDS
+#define MMU_EXTERNAL_HEAP_CACHE_LINE_WORDS 16
+#endif
+#ifndef MMU_EXTERNAL_HEAP_PREFETCH
+#define MMU_EXTERNAL_HEAP_PREFETCH 1
+#endif
+
+constexpr int spi_words = 16;   // Size of the HSPI data buffer in words
+constexpr int cache_ways = MMU_EXTERNAL_HEAP_CACHE_WAYS;        // N-way associative inside each set
+constexpr int cache_sets = MMU_EXTERNAL_HEAP_CACHE_SETS;        // 1 makes the cache fully associative
+constexpr int cache_words = MMU_EXTERNAL_HEAP_CACHE_LINE_WORDS; // Lines longer than the SPI buffer take several transactions
+constexpr int chunk_words = (cache_words < spi_words) ? cache_words : spi_words;
+constexpr int cache_chunks = cache_words / chunk_words;
+// Prefetch needs a spare way and a line that a single background transaction can fill
+constexpr bool cache_prefetch = MMU_EXTERNAL_HEAP_PREFETCH && (cache_ways > 1) && (cache_chunks == 1);
+
+static_assert(cache_sets > 0 && (cache_sets & (cache_sets - 1)) == 0, "Cache sets must be a power of 2");
+static_assert(cache_words > 0 && (cache_words & (cache_words - 1)) == 0, "Cache line words must be a power of 2");
 
 static struct cache_line {
   int32_t addr;            // Address, lower bits masked off
   int dirty;               // Needs writeback
+  int prefetched;          // Filled by prefetch and not yet used
   struct cache_line *next; // We'll keep linked list in MRU order
   union {
     uint32_t w[cache_words];
     uint16_t s[cache_words * 2];
     uint8_t  b[cache_words * 4];
   };
-} __vm_cache_line[cache_ways];
-static struct cache_line *__vm_cache; // Always points to MRU (hence the line being read/written)
+} __vm_cache_line[cache_sets][cache_ways];
+static struct cache_line *__vm_cache[cache_sets]; // MRU of each set
+
+constexpr int line_bytes = sizeof(__vm_cache_line[0][0].w);
+constexpr int chunk_bytes = chunk_words * 4;
+constexpr int addrmask = ~(line_bytes - 1); // Helper to mask off bits present in cache entry
 
-constexpr int addrmask = ~(sizeof(__vm_cache[0].w)-1); // Helper to mask off bits present in cache entry
+static struct cache_line *__vm_prefetch;  // Line being filled in the background, NULL if none
+static int32_t __vm_prefetch_addr;        // Address it will hold once the fill completes
+static int32_t __vm_last_miss = -1;       // Previous demand miss, sequential streams trigger prefetch
 
+static struct vm_cache_stats __vm_stats;
 
 static void spi_init(spi_regs *spi1)
 {
@@ -200,7 +241,7 @@ inline IRAM_ATTR void spi_writetransaction(spi_regs *spi1, int addr, int addr_bi
   }
 }
 
-inline IRAM_ATTR uint32_t spi_readtransaction(spi_regs *spi1, int addr, int addr_bits, int dummy_bits, int data_bits, iotype dual)
+inline IRAM_ATTR void spi_startread(spi_regs *spi1, int addr, int addr_bits, int dummy_bits, int data_bits, iotype dual)
 {
   // Ensure no writes are still ongoing
   while (spi1->spi_cmd & SPIBUSY) { /* busywait */ }
@@ -211,58 +252,160 @@ inline IRAM_ATTR uint32_t spi_readtransaction(spi_regs *spi1, int addr, int addr
   // No need to set spi_user2, insn field never used
   __asm ( "" ::: "memory" );
   spi1->spi_cmd = SPIBUSY;
+}
+
+inline IRAM_ATTR uint32_t spi_readtransaction(spi_regs *spi1, int addr, int addr_bits, int dummy_bits, int data_bits, iotype dual)
+{
+  spi_startread(spi1, addr, addr_bits, dummy_bits, data_bits, dual);
   while (spi1->spi_cmd & SPIBUSY) { /* busywait */ }
   __asm ( "" ::: "memory" );
   return spi1->spi_w[0];
 }
 
-static inline IRAM_ATTR void cache_flushrefill(spi_regs *spi1, int addr)
+static inline IRAM_ATTR void cache_line_read(spi_regs *spi1, struct cache_line *line, int addr)
+{
+  for (auto i = 0; i < cache_chunks; i++) {
+    spi_readtransaction(spi1, (0x03 << 24) | (addr + i * chunk_bytes), 32-1, read_delay, chunk_bytes * 8 - 1, hspi_mode);
+    memcpy(&line->w[i * chunk_words], spi1->spi_w, chunk_bytes);
+  }
+}
+
+static inline IRAM_ATTR void cache_line_write(spi_regs *spi1, struct cache_line *line)
+{
+  // Each chunk runs in the background, the next transaction waits for it
+  for (auto i = 0; i < cache_chunks; i++) {
+    while (spi1->spi_cmd & SPIBUSY) { /* busywait */ }
+    memcpy(spi1->spi_w, &line->w[i * chunk_words], chunk_bytes);
+    spi_writetransaction(spi1, (0x02 << 24) | (line->addr + i * chunk_bytes), 32-1, 0, chunk_bytes * 8 - 1, hspi_mode);
+  }
+  line->dirty = 0;
+  __vm_stats.writebacks++;
+}
+
+static inline IRAM_ATTR int cache_set(int addr)
+{
+  return (addr / line_bytes) & (cache_sets - 1);
+}
+
+static inline IRAM_ATTR void cache_prefetch_complete(spi_regs *spi1)
+{
+  while (spi1->spi_cmd & SPIBUSY) { /* busywait */ }
+  __asm ( "" ::: "memory" );
+  memcpy(__vm_prefetch->w, spi1->spi_w, line_bytes);
+  __vm_prefetch->addr = __vm_prefetch_addr;
+  __vm_prefetch = NULL;
+}
+
+static inline IRAM_ATTR void cache_prefetch_start(spi_regs *spi1, int addr)
+{
+  if ((uint32_t)addr > VM_OFFSET_MASK) return;
+
+  struct cache_line *way = __vm_cache[cache_set(addr)];
+  struct cache_line *lru = way;
+  for (auto i = 0; i < cache_ways; i++) {
+    if (way->addr == addr) return; // Already cached
+    lru = way;
+    way = way->next;
+  }
+
+  // Don't delay the stream by a writeback, just skip this prefetch
+  if (lru->dirty) return;
+
+  // Invalid until cache_prefetch_complete() copies the data out of the SPI buffer
+  lru->addr = -1;
+  lru->prefetched = 1;
+  __vm_prefetch = lru;
+  __vm_prefetch_addr = addr;
+  spi_startread(spi1, (0x03 << 24) | addr, 32-1, read_delay, line_bytes * 8 - 1, hspi_mode);
+  __vm_stats.prefetches++;
+}
+
+static inline IRAM_ATTR struct cache_line *cache_hit(spi_regs *spi1, struct cache_line *way)
+{
+  // First use of a prefetched line keeps the stream going
+  if (cache_prefetch && way->prefetched) {
+    way->prefetched = 0;
+    __vm_last_miss = way->addr;
+    __vm_stats.prefetch_hits++;
+    cache_prefetch_start(spi1, way->addr + line_bytes);
+  }
+  return way;
+}
+
+static inline IRAM_ATTR struct cache_line *cache_flushrefill(spi_regs *spi1, int addr)
 {
   addr &= addrmask;
-  struct cache_line *way = __vm_cache;
+  __vm_stats.accesses++;
+
+  // A background fill owns the SPI buffer, collect it before anything else
+  if (cache_prefetch && __vm_prefetch) {
+    cache_prefetch_complete(spi1);
+  }
 
-  if (__vm_cache->addr == addr) return; // Fast case, it already is the MRU
+  const int set = cache_set(addr);
+  struct cache_line *way = __vm_cache[set];
+
+  if (way->addr == addr) return cache_hit(spi1, way); // Fast case, it already is the MRU
   struct cache_line *last = way;
   way = way->next;
 
   for (auto i = 1; i < cache_ways; i++) {
     if (way->addr == addr) {
       last->next = way->next;
-      way->next = __vm_cache;
-      __vm_cache = way;
-      return;
+      way->next = __vm_cache[set];
+      __vm_cache[set] = way;
+      return cache_hit(spi1, way);
     } else {
       last = way;
       way = way->next;
     }
   }
 
-  // At this point we know the line is not in the cache and way points to the LRU.
-
-  // We allow reads to go before writes since the write can happen in the background.
-  // We need to keep the data to be written back since it will be overwritten with read data
-  uint32_t wb[cache_words];
-  if (last->dirty) {
-    memcpy(wb, last->w, sizeof(last->w));
-  }
+  // At this point we know the line is not in the cache and last points to the LRU.
+  __vm_stats.misses++;
 
   // Update MRU info, list
-  last->next = __vm_cache;
-  __vm_cache = last;
-
-  // Do the actual read
-  spi_readtransaction(spi1, (0x03 << 24) | addr, 32-1, read_delay, sizeof(last->w) * 8 - 1, hspi_mode);
-  memcpy(last->w, spi1->spi_w, sizeof(last->w));
-
-  // We fire a background writeback now, if needed
-  if (last->dirty) {
-    memcpy(spi1->spi_w, wb, sizeof(wb));
-    spi_writetransaction(spi1, (0x02 << 24) | last->addr, 32-1, 0, sizeof(last->w) * 8 - 1, hspi_mode);
-    last->dirty = 0;
+  last->next = __vm_cache[set];
+  __vm_cache[set] = last;
+
+  if (cache_chunks == 1) {
+    // We allow reads to go before writes since the write can happen in the background.
+    // We need to keep the data to be written back since it will be overwritten with read data
+    uint32_t wb[cache_words];
+    const int32_t wbaddr = last->addr;
+    if (last->dirty) {
+      memcpy(wb, last->w, sizeof(last->w));
+    }
+
+    // Do the actual read
+    cache_line_read(spi1, last, addr);
+
+    // We fire a background writeback now, if needed
+    if (last->dirty) {
+      memcpy(spi1->spi_w, wb, sizeof(wb));
+      spi_writetransaction(spi1, (0x02 << 24) | wbaddr, 32-1, 0, sizeof(last->w) * 8 - 1, hspi_mode);
+      last->dirty = 0;
+      __vm_stats.writebacks++;
+    }
+  } else {
+    // Long lines don't fit the SPI buffer, so write back first
+    if (last->dirty) {
+      cache_line_write(spi1, last);
+    }
+    cache_line_read(spi1, last, addr);
   }
 
   // Update the addr at this point since we no longer need the old one
   last->addr = addr;
+  last->prefetched = 0;
+
+  if (cache_prefetch) {
+    if (addr == __vm_last_miss + line_bytes) {
+      cache_prefetch_start(spi1, addr + line_bytes);
+    }
+    __vm_last_miss = addr;
+  }
+  return last;
 }
 
 static inline IRAM_ATTR void spi_ramwrite(spi_regs *spi1, int addr, int data_bits, uint32_t val)
@@ -271,13 +414,13 @@ static inline IRAM_ATTR void spi_ramwrite(spi_regs *spi1, int addr, int data_bit
     spi1->spi_w[0] = val;
     spi_writetransaction(spi1, (0x02<<24) | addr, 32-1, 0, data_bits, hspi_mode);
   } else {
-    cache_flushrefill(spi1, addr);
-    __vm_cache->dirty = 1;
-    addr -= __vm_cache->addr;
+    struct cache_line *line = cache_flushrefill(spi1, addr);
+    line->dirty = 1;
+    addr -= line->addr;
     switch (data_bits) {
-      case 31: __vm_cache->w[addr >> 2] = val; break;
-      case  7: __vm_cache->b[addr] = val; break;
-      default: __vm_cache->s[addr >> 1] = val; break;
+      case 31: line->w[addr >> 2] = val; break;
+      case  7: line->b[addr] = val; break;
+      default: line->s[addr >> 1] = val; break;
     }
   }
 }
@@ -288,12 +431,12 @@ static inline IRAM_ATTR uint32_t spi_ramread(spi_regs *spi1, int addr, int data_
     spi1->spi_w[0] = 0;
     return spi_readtransaction(spi1, (0x03 << 24) | addr, 32-1, read_delay, data_bits, hspi_mode);
   } else {
-    cache_flushrefill(spi1, addr);
-    addr -= __vm_cache->addr;
+    struct cache_line *line = cache_flushrefill(spi1, addr);
+    addr -= line->addr;
     switch (data_bits) {
-      case 31: return __vm_cache->w[addr >> 2];
-      case  7: return __vm_cache->b[addr];
-      default: return __vm_cache->s[addr >> 1];
+      case 31: return line->w[addr >> 2];
+      case  7: return line->b[addr];
+      default: return line->s[addr >> 1];
     }
   }
 }
@@ -383,12 +526,14 @@ void install_vm_exception_handler()
 
   // Bring cache structures to baseline
   if (cache_ways > 0) {
-    for (auto i = 0; i < cache_ways; i++) {
-      __vm_cache_line[i].addr = -1; // Invalid, bits set in lower region so will never match
-      __vm_cache_line[i].next = &__vm_cache_line[i+1];
+    for (auto set = 0; set < cache_sets; set++) {
+      for (auto i = 0; i < cache_ways; i++) {
+        __vm_cache_line[set][i].addr = -1; // Invalid, bits set in lower region so will never match
+        __vm_cache_line[set][i].next = &__vm_cache_line[set][i+1];
+      }
+      __vm_cache[set] = &__vm_cache_line[set][0];
+      __vm_cache_line[set][cache_ways - 1].next = NULL;
     }
-    __vm_cache = &__vm_cache_line[0];
-    __vm_cache_line[cache_ways - 1].next = NULL;
   }
 
   // Our umm_malloc configuration can only support a maximum of 256K RAM. A
@@ -400,6 +545,136 @@ void install_vm_exception_handler()
   umm_init_vm( (void *)0x10000000, MMU_EXTERNAL_HEAP * 1024);
 }
 
+static inline bool is_vm(const void *p)
+{
+  return ((uintptr_t)p >> 28) == 1;
+}
+
+// Make the external RAM current for [addr, addr+len) before a direct transfer:
+// dirty lines are written back, and dropped as well if the range is about to be overwritten
+static void cache_sync_range(spi_regs *spi1, int addr, size_t len, bool invalidate)
+{
+  if (cache_prefetch && __vm_prefetch) {
+    cache_prefetch_complete(spi1);
+  }
+  for (auto set = 0; set < cache_sets; set++) {
+    for (auto i = 0; i < cache_ways; i++) {
+      struct cache_line *line = &__vm_cache_line[set][i];
+      if ((line->addr < 0) || (line->addr + line_bytes <= addr) || (line->addr >= addr + (int)len)) {
+        continue;
+      }
+      if (line->dirty) {
+        cache_line_write(spi1, line);
+      }
+      if (invalidate) {
+        line->addr = -1;
+        line->prefetched = 0;
+      }
+    }
+  }
+  while (spi1->spi_cmd & SPIBUSY) { /* busywait */ }
+}
+
+// Copies through the HSPI buffer in blocks of up to 64 bytes instead of taking an
+// exception per word. Interrupts are held off per block so an ISR touching VM
+// can't clobber the SPI buffer or the cache in the middle of a transfer.
+void *vm_memcpy(void *dst, const void *src, size_t len)
+{
+  const bool dst_vm = is_vm(dst);
+  const bool src_vm = is_vm(src);
+  if (!dst_vm && !src_vm) {
+    return memcpy(dst, src, len);
+  }
+
+  DECLARE_SPI1;
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+  uint32_t buf[spi_words];
+
+  while (len) {
+    const size_t n = std::min(len, sizeof(buf));
+    const int daddr = (uintptr_t)d & VM_OFFSET_MASK;
+    const int saddr = (uintptr_t)s & VM_OFFSET_MASK;
+
+    uint32_t savedPS = xt_rsil(15);
+    // Both syncs may write back dirty lines through the SPI buffer, so they
+    // go before the read that leaves the source data there
+    if (dst_vm && cache_ways > 0) {
+      cache_sync_range(spi1, daddr, n, true);
+    }
+    if (src_vm) {
+      if (cache_ways > 0) {
+        cache_sync_range(spi1, saddr, n, false);
+      }
+      spi_readtransaction(spi1, (0x03 << 24) | saddr, 32-1, read_delay, n * 8 - 1, hspi_mode);
+      if (!dst_vm) {
+        for (size_t i = 0; i < (n + 3) / 4; i++) {
+          buf[i] = spi1->spi_w[i];
+        }
+        memcpy(d, buf, n);
+      }
+      // VM to VM: the data is already in the SPI buffer for the write below
+    } else {
+      memcpy(buf, s, n);
+    }
+    if (dst_vm) {
+      while (spi1->spi_cmd & SPIBUSY) { /* busywait */ }
+      if (!src_vm) {
+        for (size_t i = 0; i < (n + 3) / 4; i++) {
+          spi1->spi_w[i] = buf[i];
+        }
+      }
+      spi_writetransaction(spi1, (0x02 << 24) | daddr, 32-1, 0, n * 8 - 1, hspi_mode);
+    }
+    xt_wsr_ps(savedPS);
+
+    d += n;
+    s += n;
+    len -= n;
+  }
+  return dst;
+}
+
+void *vm_memset(void *dst, int c, size_t len)
+{
+  if (!is_vm(dst)) {
+    return memset(dst, c, len);
+  }
+
+  DECLARE_SPI1;
+  uint8_t *d = (uint8_t *)dst;
+  const uint32_t fill = 0x01010101u * (uint8_t)c;
+
+  while (len) {
+    const size_t n = std::min(len, (size_t)spi_words * 4);
+    const int daddr = (uintptr_t)d & VM_OFFSET_MASK;
+
+    uint32_t savedPS = xt_rsil(15);
+    if (cache_ways > 0) {
+      cache_sync_range(spi1, daddr, n, true);
+    }
+    for (auto i = 0; i < spi_words; i++) {
+      spi1->spi_w[i] = fill;
+    }
+    spi_writetransaction(spi1, (0x02 << 24) | daddr, 32-1, 0, n * 8 - 1, hspi_mode);
+    xt_wsr_ps(savedPS);
+
+    d += n;
+    len -= n;
+  }
+  return dst;
+}
+
+void vm_get_cache_stats(struct vm_cache_stats *stats, int reset)
+{
+  uint32_t savedPS = xt_rsil(15);
+  *stats = __vm_stats;
+  if (reset) {
+    memset(&__vm_stats, 0, sizeof(__vm_stats));
+  }
+  xt_wsr_ps(savedPS);
+}
+
 
 };
 
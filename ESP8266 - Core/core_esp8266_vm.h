@@ -1,11 +1,29 @@
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern void install_vm_exception_handler();
 
+// Bulk transfers to/from external RAM (0x10000000..) without taking a load/store
+// exception per access. Either side may be external RAM, the other side must be
+// byte addressable memory. Fall back to plain memcpy/memset otherwise.
+extern void *vm_memcpy(void *dst, const void *src, size_t len);
+extern void *vm_memset(void *dst, int c, size_t len);
+
+struct vm_cache_stats {
+  uint32_t accesses;      // Loads/stores through the exception handler
+  uint32_t misses;        // Demand line fills
+  uint32_t writebacks;    // Dirty lines written back
+  uint32_t prefetches;    // Sequential prefetches issued
+  uint32_t prefetch_hits; // Prefetched lines that were used
+};
+
+extern void vm_get_cache_stats(struct vm_cache_stats *stats, int reset);
+
 
 #ifdef __cplusplus
 };
 #endif
-
@@ -110,11 +110,30 @@ int stopWaveform(uint8_t pin);
 // Make sure the CB function has the IRAM_ATTR decorator.
 void setTimer1Callback(uint32_t (*fn)());
 
+// Build with -DWAVEFORM_NMI_STATS=1 to measure the cost of the timer1 NMI of the
+// default (PWM) waveform generator.  cycles / edges gives the average CPU cycles
+// spent per generated edge, busy waits for closely spaced edges included.
+#ifndef WAVEFORM_NMI_STATS
+#define WAVEFORM_NMI_STATS 0
+#endif
+#if WAVEFORM_NMI_STATS
+typedef struct {
+  uint32_t calls;     // NMIs taken
+  uint32_t edges;     // PWM and waveform edges generated, PWM period starts included
+  uint32_t cycles;    // CPU cycles spent in the NMI handler
+  uint32_t maxCycles; // Longest single NMI
+} waveform_nmi_stats_t;
+
+void getWaveformNMIStats(waveform_nmi_stats_t *stats, bool reset);
+#endif
+
 
 // Internal-only calls, not for applications
 extern void _setPWMFreq(uint32_t freq);
 extern bool _stopPWM(uint8_t pin);
 extern bool _setPWM(int pin, uint32_t val, uint32_t range);
+extern bool _setPWMs(const uint8_t *pins, const uint32_t *vals, uint8_t count, uint32_t range);
+extern bool _setPWMPhase(int pin, uint32_t val, uint32_t range);
 
 #ifdef __cplusplus
 }
@@ -116,24 +116,36 @@ static IRAM_ATTR void forceTimerInterrupt() {
 
 // PWM implementation using special purpose state machine
 //
-// Keep an ordered list of pins with the delta in cycles between each
+// Keep an ordered list of edges with the delta in cycles between each
 // element, with a terminal entry making up the remainder of the PWM
 // period.  With this method sum(all deltas) == PWM period clock cycles.
 //
-// At t=0 set all pins high and set the timeout for the 1st edge.
+// At t=0 set the pins that start high and set the timeout for the 1st edge.
 // On interrupt, if we're at the last element reset to t=0 state
-// Otherwise, clear that pin down and set delay for next element
-// and so forth.
+// Otherwise, clear (or for phase shifted pins, set) that pin and set delay
+// for next element and so forth.
+//
+// A pin with no phase offset is high at t=0 and has a single falling edge.
+// One with an offset has a rising edge at the offset and a falling one a
+// duty cycle later, wrapping around to start high when that passes t=0.
+
+#ifndef WAVEFORM_PWM_CHANNELS
+#define WAVEFORM_PWM_CHANNELS 8
+#endif
+constexpr int maxPWMs = WAVEFORM_PWM_CHANNELS;
+static_assert(maxPWMs > 0 && maxPWMs <= 17, "WAVEFORM_PWM_CHANNELS must be 1..17");
 
-constexpr int maxPWMs = 8;
+#define PWM_EDGE_RISE 0x80 // Set in pin[] for a rising edge
+#define PWM_EDGE_PIN  0x1f
 
 // PWM machine state
 typedef struct PWMState {
-  uint32_t mask; // Bitmask of active pins
-  uint32_t cnt;  // How many entries
-  uint32_t idx;  // Where the state machine is along the list
-  uint8_t  pin[maxPWMs + 1];
-  uint32_t delta[maxPWMs + 1];
+  uint32_t mask;     // Bitmask of active pins
+  uint32_t highMask; // Active pins that are high at t=0
+  uint32_t cnt;      // How many entries
+  uint32_t idx;      // Where the state machine is along the list
+  uint8_t  pin[2 * maxPWMs + 1];
+  uint32_t delta[2 * maxPWMs + 1];
   uint32_t nextServiceCycle;  // Clock cycle for next step
   struct PWMState *pwmUpdate; // Set by main code, cleared by ISR
 } PWMState;
@@ -141,6 +153,11 @@ typedef struct PWMState {
 static PWMState pwmState;
 static uint32_t _pwmFreq = 1000;
 static uint32_t _pwmPeriod = MicrosecondsToClockCycles(1000000UL) / _pwmFreq;
+static uint16_t _pwmPhase[17]; // Per-pin phase offset, in 1/65536ths of the period
+
+#if WAVEFORM_NMI_STATS
+static waveform_nmi_stats_t nmiStats;
+#endif
 
 
 // If there are no more scheduled activities, shut down Timer 1.
@@ -197,9 +214,10 @@ void _setPWMFreq_weak(uint32_t freq) {
   if (pwmState.cnt) {
     PWMState p;  // The working copy since we can't edit the one in use
     p.mask = 0;
+    p.highMask = 0;
     p.cnt = 0;
-    for (uint32_t i = 0; i < pwmState.cnt; i++) {
-      auto pin = pwmState.pin[i];
+    for (uint32_t m = pwmState.mask; m; m &= m - 1) {
+      auto pin = __builtin_ctz(m);
       _addPWMtoList(p, pin, wvfState.waveform[pin].desiredHighCycles, wvfState.waveform[pin].desiredLowCycles);
     }
     // Update and wait for mailbox to be emptied
@@ -220,17 +238,19 @@ static void _cleanAndRemovePWM(PWMState *p, int pin) {
   uint32_t leftover = 0;
   uint32_t in, out;
   for (in = 0, out = 0; in < p->cnt; in++) {
-    if ((p->pin[in] != pin) && (p->mask & (1<<p->pin[in]))) {
+    int edgePin = p->pin[in] & PWM_EDGE_PIN;
+    if ((edgePin != pin) && (p->mask & (1<<edgePin))) {
         p->pin[out] = p->pin[in];
         p->delta[out] = p->delta[in] + leftover;
         leftover = 0;
         out++;
     } else {
         leftover += p->delta[in];
-        p->mask &= ~(1<<p->pin[in]);
+        p->mask &= ~(1<<edgePin);
     }
   }
   p->cnt = out;
+  p->highMask &= p->mask;
   // Final pin is never used: p->pin[out] = 0xff;
   p->delta[out] = p->delta[in] + leftover;
 }
@@ -249,6 +269,7 @@ IRAM_ATTR bool _stopPWM_weak(uint8_t pin) {
   // In _stopPWM we just clear the mask but keep everything else
   // untouched to save IRAM.  The main startPWM will handle cleanup.
   p.mask &= ~(1<<pin);
+  p.highMask &= ~(1<<pin);
   if (!p.mask) {
     // If all have been stopped, then turn PWM off completely
     p.cnt = 0;
@@ -265,27 +286,11 @@ IRAM_ATTR bool _stopPWM(uint8_t pin) {
   return _stopPWM_bound(pin);
 }
 
-static void _addPWMtoList(PWMState &p, int pin, uint32_t val, uint32_t range) {
-  // Stash the val and range so we can re-evaluate the fraction
-  // should the user change PWM frequency.  This allows us to
-  // give as great a precision as possible.  We know by construction
-  // that the waveform for this pin will be inactive so we can borrow
-  // memory from that structure.
-  wvfState.waveform[pin].desiredHighCycles = val;  // Numerator == high
-  wvfState.waveform[pin].desiredLowCycles = range; // Denominator == low
-
-  uint32_t cc = (_pwmPeriod * val) / range;
-
-  // Clip to sane values in the case we go from OK to not-OK when adjusting frequencies
-  if (cc == 0) {
-    cc = 1;
-  } else if (cc >= _pwmPeriod) {
-    cc = _pwmPeriod - 1;
-  }
-
+// Insert an edge at cycle cc (0 < cc < _pwmPeriod) of the period
+static void _addPWMEdge(PWMState &p, uint8_t edge, uint32_t cc) {
   if (p.cnt == 0) {
     // Starting up from scratch, special case 1st element and PWM period
-    p.pin[0] = pin;
+    p.pin[0] = edge;
     p.delta[0] = cc;
    // Final pin is never used: p.pin[1] = 0xff;
     p.delta[1] = _pwmPeriod - cc;
@@ -302,11 +307,48 @@ static void _addPWMtoList(PWMState &p, int pin, uint32_t val, uint32_t range) {
       p.delta[j + 1] = p.delta[j];
     }
     int off = cc - ttl; // The delta from the last edge to the one we're inserting
-    p.pin[i] = pin;
+    p.pin[i] = edge;
     p.delta[i] = off; // Add the delta to this new pin
     p.delta[i + 1] -= off; // And subtract it from the follower to keep sum(deltas) constant
   }
   p.cnt++;
+}
+
+static void _addPWMtoList(PWMState &p, int pin, uint32_t val, uint32_t range) {
+  // Stash the val and range so we can re-evaluate the fraction
+  // should the user change PWM frequency.  This allows us to
+  // give as great a precision as possible.  We know by construction
+  // that the waveform for this pin will be inactive so we can borrow
+  // memory from that structure.
+  wvfState.waveform[pin].desiredHighCycles = val;  // Numerator == high
+  wvfState.waveform[pin].desiredLowCycles = range; // Denominator == low
+
+  uint32_t cc = (_pwmPeriod * val) / range;
+
+  // Clip to sane values in the case we go from OK to not-OK when adjusting frequencies
+  if (cc == 0) {
+    cc = 1;
+  } else if (cc >= _pwmPeriod) {
+    cc = _pwmPeriod - 1;
+  }
+
+  uint32_t rise = ((uint64_t)_pwmPeriod * _pwmPhase[pin]) >> 16;
+  if (rise == 0) {
+    p.highMask |= 1<<pin;
+    _addPWMEdge(p, pin, cc);
+  } else {
+    uint32_t fall = rise + cc;
+    if (fall > _pwmPeriod) {
+      // High across t=0
+      fall -= _pwmPeriod;
+      p.highMask |= 1<<pin;
+    } else if (fall == _pwmPeriod) {
+      // High up to the end of the period, edges have to stay inside it
+      fall = _pwmPeriod - 1;
+    }
+    _addPWMEdge(p, pin | PWM_EDGE_RISE, rise);
+    _addPWMEdge(p, pin, fall);
+  }
   p.mask |= 1<<pin;
 }
 
@@ -319,7 +361,7 @@ bool _setPWM_weak(int pin, uint32_t val, uint32_t range) {
   // Get rid of any entries for this pin
   _cleanAndRemovePWM(&p, pin);
   // And add it to the list, in order
-  if (p.cnt >= maxPWMs) {
+  if (__builtin_popcount(p.mask) >= maxPWMs) {
     return false; // No space left
   }
 
@@ -347,6 +389,81 @@ bool _setPWM(int pin, uint32_t val, uint32_t range) {
   return _setPWM_bound(pin, val, range);
 }
 
+// Set the duty of several pins at once.  The whole new edge list is built
+// here and handed to the NMI in one mailbox update, so every pin switches
+// to its new duty at the start of the same period.
+extern bool _setPWMs_weak(const uint8_t *pins, const uint32_t *vals, uint8_t count, uint32_t range) __attribute__((weak));
+bool _setPWMs_weak(const uint8_t *pins, const uint32_t *vals, uint8_t count, uint32_t range) {
+  PWMState p;  // Working copy
+  p = pwmState;
+  uint32_t fullOn = 0, fullOff = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if ((pins[i] > 16) || isFlashInterfacePin(pins[i])) {
+      return false;
+    }
+    _cleanAndRemovePWM(&p, pins[i]);
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t cc = (_pwmPeriod * vals[i]) / range;
+    if ((cc == 0) || (cc >= _pwmPeriod)) {
+      (cc ? fullOn : fullOff) |= 1<<pins[i];
+    } else if (!(p.mask & (1<<pins[i]))) {
+      if (__builtin_popcount(p.mask) >= maxPWMs) {
+        return false; // No space left, nothing has been changed
+      }
+      _addPWMtoList(p, pins[i], vals[i], range);
+    }
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    stopWaveform(pins[i]);
+  }
+
+  // Set mailbox and wait for ISR to copy it over
+  if (p.cnt || pwmState.cnt) {
+    initTimer();
+    _notifyPWM(&p, true);
+    disableIdleTimer();
+  }
+  // The pins leaving PWM for all-on/off are out of the list by now
+  for (uint32_t m = fullOn | fullOff; m; m &= m - 1) {
+    int pin = __builtin_ctz(m);
+    DigitalWrite(pin, (fullOn & (1<<pin)) ? HIGH : LOW);
+  }
+
+  // Potentially recalculate the PWM period if the number of pins changed
+  _setPWMFreq(_pwmFreq);
+
+  return true;
+}
+static bool _setPWMs_bound(const uint8_t *pins, const uint32_t *vals, uint8_t count, uint32_t range) __attribute__((weakref("_setPWMs_weak")));
+bool _setPWMs(const uint8_t *pins, const uint32_t *vals, uint8_t count, uint32_t range) {
+  return _setPWMs_bound(pins, vals, count, range);
+}
+
+// Offset the start of a pin's pulse by val/range of the period, applied
+// immediately if the pin is already running PWM
+extern bool _setPWMPhase_weak(int pin, uint32_t val, uint32_t range) __attribute__((weak));
+bool _setPWMPhase_weak(int pin, uint32_t val, uint32_t range) {
+  if ((pin > 16) || !range) {
+    return false;
+  }
+  _pwmPhase[pin] = ((uint64_t)(val % range) << 16) / range;
+  if (pwmState.mask & (1<<pin)) {
+    PWMState p;  // Working copy
+    p = pwmState;
+    _cleanAndRemovePWM(&p, pin);
+    _addPWMtoList(p, pin, wvfState.waveform[pin].desiredHighCycles, wvfState.waveform[pin].desiredLowCycles);
+    initTimer();
+    _notifyPWM(&p, true);
+    disableIdleTimer();
+  }
+  return true;
+}
+static bool _setPWMPhase_bound(int pin, uint32_t val, uint32_t range) __attribute__((weakref("_setPWMPhase_weak")));
+bool _setPWMPhase(int pin, uint32_t val, uint32_t range) {
+  return _setPWMPhase_bound(pin, val, range);
+}
+
 // Start up a waveform on a pin, or change the current one.  Will change to the new
 // waveform smoothly on next low->high transition.  For immediate change, stopWaveform()
 // first, then it will immediately Begin.
@@ -429,6 +546,19 @@ void setTimer1Callback(uint32_t (*fn)()) {
   setTimer1Callback_bound(fn);
 }
 
+#if WAVEFORM_NMI_STATS
+void getWaveformNMIStats(waveform_nmi_stats_t *stats, bool reset) {
+  // The NMI can't be masked, so copy until a consistent snapshot is read
+  do {
+    *stats = nmiStats;
+    MEMBARRIER();
+  } while (stats->calls != nmiStats.calls);
+  if (reset) {
+    nmiStats = {};
+  }
+}
+#endif
+
 // Stops a waveform on a pin
 extern int stopWaveform_weak(uint8_t pin) __attribute__((weak));
 IRAM_ATTR int stopWaveform_weak(uint8_t pin) {
@@ -497,7 +627,16 @@ static inline IRAM_ATTR uint32_t earliest(uint32_t a, uint32_t b) {
 // When the time to the next edge is greater than this, RTI and set another IRQ to minimize CPU usage
 #define MINIRQTIME MicrosecondsToClockCycles(4)
 
+#if WAVEFORM_NMI_STATS
+  #define PWM_NMI_EDGE() (nmiStats.edges++)
+#else
+  #define PWM_NMI_EDGE() do {} while (0)
+#endif
+
 static IRAM_ATTR void timer1Interrupt() {
+#if WAVEFORM_NMI_STATS
+  uint32_t entryCycle = GetCycleCountIRQ();
+#endif
   // Flag if the core is at 160 MHz, for use by adjust()
   bool turbo = (*(uint32_t*)0x3FF00014) & 1 ? true : false;
 
@@ -539,21 +678,29 @@ static IRAM_ATTR void timer1Interrupt() {
                     // Do the memory copy from temp to global and clear mailbox
                     pwmState = *(PWMState*)pwmState.pwmUpdate;
                   }
-                  GPOS = pwmState.mask; // Set all active pins high
-                  if (pwmState.mask & (1<<16)) {
+                  GPOS = pwmState.highMask; // Set all pins starting the period high
+                  if (pwmState.highMask & (1<<16)) {
                     GP16O = 1;
                   }
                   pwmState.idx = 0;
+                  PWM_NMI_EDGE();
                 } else {
                   do {
-                    // Drop the pin at this edge
-                    if (pwmState.mask & (1<<pwmState.pin[pwmState.idx])) {
-                      GPOC = 1<<pwmState.pin[pwmState.idx];
-                      if (pwmState.pin[pwmState.idx] == 16) {
-                        GP16O = 0;
+                    // Drop (or raise) the pin at this edge
+                    uint8_t edge = pwmState.pin[pwmState.idx];
+                    uint32_t edgeMask = 1<<(edge & PWM_EDGE_PIN);
+                    if (pwmState.mask & edgeMask) {
+                      if (edge & PWM_EDGE_RISE) {
+                        GPOS = edgeMask;
+                      } else {
+                        GPOC = edgeMask;
+                      }
+                      if (edgeMask & (1<<16)) {
+                        GP16O = (edge & PWM_EDGE_RISE) ? 1 : 0;
                       }
                     }
                     pwmState.idx++;
+                    PWM_NMI_EDGE();
                     // Any other pins at this same PWM value will have delta==0, drop them too.
                   } while (pwmState.delta[pwmState.idx] == 0);
                 }
@@ -637,6 +784,7 @@ static IRAM_ATTR void timer1Interrupt() {
           nextEdgeCycles = adjust(nextEdgeCycles);
           wave->nextServiceCycle = now + nextEdgeCycles;
           wave->lastEdge = now;
+          PWM_NMI_EDGE();
         }
         nextEventCycle = earliest(nextEventCycle, wave->nextServiceCycle);
       }
@@ -662,6 +810,15 @@ static IRAM_ATTR void timer1Interrupt() {
 
   // Do it here instead of global function to save time and because we know it's edge-IRQ
   T1L = nextEventCycles >> (turbo ? 1 : 0);
+
+#if WAVEFORM_NMI_STATS
+  uint32_t spent = GetCycleCountIRQ() - entryCycle;
+  nmiStats.cycles += spent;
+  if (spent > nmiStats.maxCycles) {
+    nmiStats.maxCycles = spent;
+  }
+  nmiStats.calls++;
+#endif
 }
 
 };
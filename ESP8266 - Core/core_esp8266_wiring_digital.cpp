@@ -130,6 +130,37 @@ typedef struct {
 
 static interrupt_handler_t interrupt_handlers[16] = { {0, 0, 0, 0}, };
 static uint32_t interrupt_reg = 0;
+static uint32_t capture_reg = 0; // subset of interrupt_reg queued instead of dispatched
+
+#ifndef GPIO_CAPTURE_RING_SIZE
+#define GPIO_CAPTURE_RING_SIZE 64
+#endif
+static_assert((GPIO_CAPTURE_RING_SIZE & (GPIO_CAPTURE_RING_SIZE - 1)) == 0, "GPIO_CAPTURE_RING_SIZE must be a power of 2");
+
+// Single producer (the GPIO ISR), single consumer (ReadCapturedEdge), no lock needed
+static gpio_edge_t capture_ring[GPIO_CAPTURE_RING_SIZE];
+static volatile uint32_t capture_head = 0;
+static volatile uint32_t capture_tail = 0;
+static volatile uint32_t capture_dropped = 0;
+
+static inline IRAM_ATTR void capture_edges(uint32_t bits, uint32_t levels, uint32_t ccount)
+{
+  uint32_t head = capture_head;
+  while (bits) {
+    int i = __builtin_ctz(bits);
+    bits &= bits - 1;
+    if (head - capture_tail >= GPIO_CAPTURE_RING_SIZE) {
+      capture_dropped = capture_dropped + 1;
+      continue;
+    }
+    gpio_edge_t* edge = &capture_ring[head & (GPIO_CAPTURE_RING_SIZE - 1)];
+    edge->pin = i;
+    edge->level = (levels >> i) & 1;
+    edge->ccount = ccount;
+    head++;
+  }
+  capture_head = head;
+}
 
 void IRAM_ATTR interrupt_handler(void *arg, void *frame)
 {
@@ -140,37 +171,51 @@ void IRAM_ATTR interrupt_handler(void *arg, void *frame)
   uint32_t levels = GPI;
   if(status == 0 || interrupt_reg == 0) return;
   ETS_GPIO_INTR_DISABLE();
-  int i = 0;
   uint32_t changedbits = status & interrupt_reg;
-  while(changedbits){
-    while(!(changedbits & (1 << i))) i++;
-    changedbits &= ~(1 << i);
-    interrupt_handler_t *handler = &interrupt_handlers[i];
-    if (handler->fn && 
-        (handler->mode == CHANGE || 
-         (handler->mode & 1) == !!(levels & (1 << i)))) {
-          // to make ISR compatible to Arduino AVR model where interrupts are disabled
-          // we disable them before we call the client ISR
-          esp8266::InterruptLock irqLock; // stop other interrupts
-          if (handler->functional)
-          {
-              ArgStructure* localArg = (ArgStructure*)handler->arg;
-              if (localArg && localArg->interruptInfo)
-              {
-                  localArg->interruptInfo->pin = i;
-                  localArg->interruptInfo->value = __DigitalRead(i);
-                  localArg->interruptInfo->micro = Micros();
-              }
-          }
-          if (handler->arg)
-          {
-              ((voidFuncPtrArg)handler->fn)(handler->arg);
-          }
-          else
-          {
-              handler->fn();
-          }
-      }
+
+  // Captured pins share one timestamp and the GPI snapshot taken above
+  if (changedbits & capture_reg) {
+    capture_edges(changedbits & capture_reg, levels, esp_get_cycle_count());
+    changedbits &= ~capture_reg;
+  }
+
+  if (changedbits) {
+    // to make ISR compatible to Arduino AVR model where interrupts are disabled
+    // we disable them before we call the client ISRs, once for the whole batch
+    esp8266::InterruptLock irqLock; // stop other interrupts
+    uint32_t micro = 0;
+    bool haveMicro = false;
+    while(changedbits){
+      int i = __builtin_ctz(changedbits);
+      changedbits &= changedbits - 1;
+      interrupt_handler_t *handler = &interrupt_handlers[i];
+      if (handler->fn &&
+          (handler->mode == CHANGE ||
+           (handler->mode & 1) == !!(levels & (1 << i)))) {
+            if (handler->functional)
+            {
+                ArgStructure* localArg = (ArgStructure*)handler->arg;
+                if (localArg && localArg->interruptInfo)
+                {
+                    if (!haveMicro) {
+                        micro = Micros();
+                        haveMicro = true;
+                    }
+                    localArg->interruptInfo->pin = i;
+                    localArg->interruptInfo->value = (levels >> i) & 1;
+                    localArg->interruptInfo->micro = micro;
+                }
+            }
+            if (handler->arg)
+            {
+                ((voidFuncPtrArg)handler->fn)(handler->arg);
+            }
+            else
+            {
+                handler->fn();
+            }
+        }
+    }
   }
   ETS_GPIO_INTR_ENABLE();
 }
@@ -205,6 +250,7 @@ extern void __AttachInterruptFunctionalArg(uint8_t pin, voidFuncPtrArg userFunc,
     ETS_GPIO_INTR_DISABLE();
     set_interrupt_handlers(pin, (voidFuncPtr)userFunc, arg, mode, functional);
     interrupt_reg |= (1 << pin);
+    capture_reg &= ~(1 << pin); // may have been a capture pin
     GPC(pin) &= ~(0xF << GPCI);//INT mode disabled
     GPIEC = (1 << pin); //Clear Interrupt for this pin
     GPC(pin) |= ((mode & 0xF) << GPCI);//INT mode "mode"
@@ -225,6 +271,7 @@ extern void IRAM_ATTR __detachInterrupt(uint8_t pin) {
         GPC(pin) &= ~(0xF << GPCI);//INT mode disabled
         GPIEC = (1 << pin); //Clear Interrupt for this pin
         interrupt_reg &= ~(1 << pin);
+        capture_reg &= ~(1 << pin);
 		set_interrupt_handlers(pin, nullptr, nullptr, 0, false);
         if (interrupt_reg)
         {
@@ -238,6 +285,37 @@ extern void __AttachInterrupt(uint8_t pin, voidFuncPtr userFunc, int mode)
     __AttachInterruptFunctionalArg(pin, (voidFuncPtrArg)userFunc, 0, mode, false);
 }
 
+extern void __AttachCaptureInterrupt(uint8_t pin, int mode)
+{
+  if(pin < 16) {
+    ETS_GPIO_INTR_DISABLE();
+    set_interrupt_handlers(pin, nullptr, nullptr, mode, false);
+    interrupt_reg |= (1 << pin);
+    capture_reg |= (1 << pin);
+    GPC(pin) &= ~(0xF << GPCI);//INT mode disabled
+    GPIEC = (1 << pin); //Clear Interrupt for this pin
+    GPC(pin) |= ((mode & 0xF) << GPCI);//INT mode "mode"
+    ETS_GPIO_INTR_ATTACH(interrupt_handler, &interrupt_reg);
+    ETS_GPIO_INTR_ENABLE();
+  }
+}
+
+extern bool __ReadCapturedEdge(gpio_edge_t* edge)
+{
+  uint32_t tail = capture_tail;
+  if (tail == capture_head) {
+    return false;
+  }
+  *edge = capture_ring[tail & (GPIO_CAPTURE_RING_SIZE - 1)];
+  capture_tail = tail + 1;
+  return true;
+}
+
+extern uint32_t __CapturedEdgesDropped()
+{
+  return capture_dropped;
+}
+
 extern void __resetPins() {
   for (int i = 0; i <= 16; ++i) {
     if (!isFlashInterfacePin(i))
@@ -261,5 +339,8 @@ extern int DigitalRead(uint8_t pin) __attribute__ ((weak, alias("__DigitalRead")
 extern void AttachInterrupt(uint8_t pin, voidFuncPtr handler, int mode) __attribute__ ((weak, alias("__AttachInterrupt")));
 extern void AttachInterruptArg(uint8_t pin, voidFuncPtrArg handler, void* arg, int mode) __attribute__((weak, alias("__AttachInterruptArg")));
 extern void detachInterrupt(uint8_t pin) __attribute__ ((weak, alias("__detachInterrupt")));
+extern void AttachCaptureInterrupt(uint8_t pin, int mode) __attribute__ ((weak, alias("__AttachCaptureInterrupt")));
+extern bool ReadCapturedEdge(gpio_edge_t* edge) __attribute__ ((weak, alias("__ReadCapturedEdge")));
+extern uint32_t CapturedEdgesDropped() __attribute__ ((weak, alias("__CapturedEdgesDropped")));
 
 };
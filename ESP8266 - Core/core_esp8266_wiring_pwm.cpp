@@ -83,6 +83,44 @@ extern void __AnalogWriteMode(uint8_t pin, int val, bool openDrain) {
   }
 }
 
+// Update several pins so the new duties all take effect in the same PWM period.
+// Returns false if that was not possible and the pins were written one at a time.
+extern bool __AnalogWriteMulti(const uint8_t *pins, const int *vals, uint8_t count) {
+  uint32_t duty[17];
+  if (count > 17) {
+    return false;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    if (pins[i] > 16) {
+      return false;
+    }
+    duty[i] = vals[i] < 0 ? 0 : (vals[i] > analogScale ? analogScale : vals[i]);
+    if (!(analogMap & 1UL << pins[i])) {
+      PinMode(pins[i], OUTPUT);
+    }
+  }
+  if (!_setPWMs(pins, duty, count, analogScale)) {
+    // Phase locked generator, or out of PWM channels: fall back to one at a time
+    for (uint8_t i = 0; i < count; i++) {
+      AnalogWrite(pins[i], duty[i]);
+    }
+    return false;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    if (duty[i] && duty[i] < (uint32_t)analogScale) {
+      analogMap |= 1UL << pins[i];
+    } else {
+      analogMap &= ~(1UL << pins[i]);
+    }
+  }
+  return true;
+}
+
+// Delay the start of the pin's pulse by phase/range (as set by AnalogWriteRange) of the period
+extern bool __AnalogWritePhase(uint8_t pin, int phase) {
+  return _setPWMPhase(pin, phase < 0 ? 0 : phase, analogScale + 1);
+}
+
 extern void __AnalogWriteRange(uint32_t range) {
   if ((range >= 15) && (range <= 65535)) {
     analogScale = range;
@@ -99,6 +137,8 @@ extern void AnalogWrite(uint8_t pin, int val) __attribute__((weak, alias("__Anal
 extern void AnalogWriteMode(uint8_t pin, int val, bool openDrain) __attribute__((weak, alias("__AnalogWriteMode")));
 extern void AnalogWriteFreq(uint32_t freq) __attribute__((weak, alias("__AnalogWriteFreq")));
 extern void AnalogWriteRange(uint32_t range) __attribute__((weak, alias("__AnalogWriteRange")));
+extern bool AnalogWriteMulti(const uint8_t *pins, const int *vals, uint8_t count) __attribute__((weak, alias("__AnalogWriteMulti")));
+extern bool AnalogWritePhase(uint8_t pin, int phase) __attribute__((weak, alias("__AnalogWritePhase")));
 extern void AnalogWriteResolution(int res) __attribute__((weak, alias("__AnalogWriteResolution")));
 
 };
@@ -18,6 +18,20 @@ void esp_suspend();
 void esp_delay(unsigned long ms);
 void esp_schedule();
 void esp_yield();
+
+// Cooperative tasks, each running fn(arg) in its own continuation with a
+// stack of stack_size bytes (CONT_STACKSIZE when 0). They take turns with
+// loop() whenever one yields, and delay() only suspends the calling task.
+typedef struct cont_task_ cont_task_t;
+cont_task_t* esp_task_create(void (*fn)(void*), void* arg, size_t stack_size);
+bool esp_task_done(const cont_task_t* task);
+// Only finished tasks can be deleted, returns false otherwise
+bool esp_task_delete(cont_task_t* task);
+// NULL when running loop() or from SYS
+cont_task_t* esp_task_current();
+// Stack high water mark and size, NULL for the loop() continuation
+int esp_task_get_free_stack(const cont_task_t* task);
+size_t esp_task_get_stack_size(const cont_task_t* task);
 void tune_timeshift64 (uint64_t now_us);
 bool sntp_set_timezone_in_seconds(int32_t timezone);
 
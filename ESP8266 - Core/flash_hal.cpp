@@ -21,6 +21,7 @@
 #include <Arduino.h>
 #include <stdlib.h>
 #include <algorithm>
+#include <string.h>
 #include "debug.h"
 #include "flash_hal.h"
 
@@ -29,8 +30,108 @@ extern "C" {
 #include "spi_flash.h"
 }
 
+static flash_hal_write_stats_t s_write_stats;
+
+#if FLASH_HAL_WRITE_COMBINING
+
+static constexpr uint32_t NoPage = ~0u;
+
+// The pending page: bytes [lo, hi) of buf go to page, the rest is 0xff
+// which programming leaves as it is
+static uint32_t s_page = NoPage;
+static uint32_t s_lo;
+static uint32_t s_hi;
+static uint8_t s_buf[FLASH_PAGE_SIZE] __attribute__((aligned(4)));
+
+int32_t flash_hal_flush(void) {
+    if (s_page == NoPage) {
+        return FLASH_HAL_OK;
+    }
+
+    FlashHalTag tag(FLASH_HAL_TAG_FS);
+    const uint32_t lo = s_lo & ~3u;
+    const uint32_t hi = (s_hi + 3) & ~3u;
+    const uint32_t page = s_page;
+    s_page = NoPage;
+    s_write_stats.programs++;
+    if (!ESP.flashWrite(page + lo, reinterpret_cast<const uint32_t *>(&s_buf[lo]), hi - lo)) {
+        return FLASH_HAL_WRITE_ERROR;
+    }
+    return FLASH_HAL_OK;
+}
+
+int32_t flash_hal_read(uint32_t addr, uint32_t size, uint8_t *dst) {
+    optimistic_yield(10000);
+    FlashHalTag tag(FLASH_HAL_TAG_FS);
+
+    if (s_page != NoPage && addr < s_page + FLASH_PAGE_SIZE && addr + size > s_page) {
+        if (flash_hal_flush() != FLASH_HAL_OK) {
+            return FLASH_HAL_READ_ERROR;
+        }
+    }
+
+    // We use flashRead overload that handles proper alignment
+    if (ESP.flashRead(addr, dst, size)) {
+        return FLASH_HAL_OK;
+    } else {
+        return FLASH_HAL_READ_ERROR;
+    }
+}
+
+int32_t flash_hal_write(uint32_t addr, uint32_t size, const uint8_t *src) {
+    optimistic_yield(10000);
+    FlashHalTag tag(FLASH_HAL_TAG_FS);
+
+    s_write_stats.writes++;
+    s_write_stats.bytes += size;
+    while (size) {
+        const uint32_t page = addr & ~(FLASH_PAGE_SIZE - 1);
+        const uint32_t offset = addr - page;
+        const uint32_t len = std::min(size, FLASH_PAGE_SIZE - offset);
+        const uint32_t end = offset + len;
+
+        s_write_stats.pieces++;
+        if (page == s_page && (end <= s_lo || offset >= s_hi)) {
+            s_lo = std::min(s_lo, offset);
+            s_hi = std::max(s_hi, end);
+        } else {
+            if (flash_hal_flush() != FLASH_HAL_OK) {
+                return FLASH_HAL_WRITE_ERROR;
+            }
+            if (len == FLASH_PAGE_SIZE) {
+                // nothing to combine a whole page with
+                s_write_stats.programs++;
+                if (!ESP.flashWrite(addr, src, len)) {
+                    return FLASH_HAL_WRITE_ERROR;
+                }
+                addr += len;
+                src += len;
+                size -= len;
+                continue;
+            }
+            memset(s_buf, 0xff, sizeof(s_buf));
+            s_page = page;
+            s_lo = offset;
+            s_hi = end;
+        }
+        memcpy(&s_buf[offset], src, len);
+
+        addr += len;
+        src += len;
+        size -= len;
+    }
+    return FLASH_HAL_OK;
+}
+
+#else // !FLASH_HAL_WRITE_COMBINING
+
+int32_t flash_hal_flush(void) {
+    return FLASH_HAL_OK;
+}
+
 int32_t flash_hal_read(uint32_t addr, uint32_t size, uint8_t *dst) {
     optimistic_yield(10000);
+    FlashHalTag tag(FLASH_HAL_TAG_FS);
 
     // We use flashRead overload that handles proper alignment
     if (ESP.flashRead(addr, dst, size)) {
@@ -42,6 +143,15 @@ int32_t flash_hal_read(uint32_t addr, uint32_t size, uint8_t *dst) {
 
 int32_t flash_hal_write(uint32_t addr, uint32_t size, const uint8_t *src) {
     optimistic_yield(10000);
+    FlashHalTag tag(FLASH_HAL_TAG_FS);
+
+    s_write_stats.writes++;
+    s_write_stats.bytes += size;
+    if (size) {
+        const uint32_t pieces = ((addr + size - 1) / FLASH_PAGE_SIZE) - (addr / FLASH_PAGE_SIZE) + 1;
+        s_write_stats.pieces += pieces;
+        s_write_stats.programs += pieces;
+    }
 
     // We use flashWrite overload that handles proper alignment
     if (ESP.flashWrite(addr, src, size)) {
@@ -51,7 +161,87 @@ int32_t flash_hal_write(uint32_t addr, uint32_t size, const uint8_t *src) {
     }
 }
 
+#endif // !FLASH_HAL_WRITE_COMBINING
+
+void flash_hal_get_write_stats(flash_hal_write_stats_t *stats) {
+    *stats = s_write_stats;
+}
+
+void flash_hal_reset_write_stats(void) {
+    memset(&s_write_stats, 0, sizeof(s_write_stats));
+}
+
+#if FLASH_HAL_STATS
+
+static flash_hal_op_stats_t s_op_stats[FLASH_HAL_OPS];
+static flash_hal_tag_stats_t s_tag_stats[FLASH_HAL_TAGS][FLASH_HAL_OPS];
+static flash_hal_tag_t s_tag = FLASH_HAL_TAG_OTHER;
+
+void flash_hal_stats_record(flash_hal_op_t op, uint32_t bytes, uint32_t us) {
+    flash_hal_op_stats_t& stats = s_op_stats[op];
+    stats.count++;
+    stats.bytes += bytes;
+    stats.total_us += us;
+    stats.max_us = std::max(stats.max_us, us);
+    const uint32_t bucket = us ? 32 - __builtin_clz(us) : 0;
+    stats.histogram[std::min(bucket, (uint32_t)FLASH_HAL_STATS_BUCKETS - 1)]++;
+
+    flash_hal_tag_stats_t& tagged = s_tag_stats[s_tag][op];
+    tagged.count++;
+    tagged.bytes += bytes;
+    tagged.total_us += us;
+}
+
+flash_hal_tag_t flash_hal_set_tag(flash_hal_tag_t tag) {
+    const flash_hal_tag_t prev = s_tag;
+    s_tag = tag;
+    return prev;
+}
+
+void flash_hal_get_stats(flash_hal_op_t op, flash_hal_op_stats_t *stats) {
+    *stats = s_op_stats[op];
+}
+
+void flash_hal_get_tag_stats(flash_hal_tag_t tag, flash_hal_op_t op, flash_hal_tag_stats_t *stats) {
+    *stats = s_tag_stats[tag][op];
+}
+
+void flash_hal_reset_stats(void) {
+    memset(s_op_stats, 0, sizeof(s_op_stats));
+    memset(s_tag_stats, 0, sizeof(s_tag_stats));
+}
+
+#else // !FLASH_HAL_STATS
+
+void flash_hal_stats_record(flash_hal_op_t op, uint32_t bytes, uint32_t us) {
+    (void)op;
+    (void)bytes;
+    (void)us;
+}
+
+flash_hal_tag_t flash_hal_set_tag(flash_hal_tag_t tag) {
+    (void)tag;
+    return FLASH_HAL_TAG_OTHER;
+}
+
+void flash_hal_get_stats(flash_hal_op_t op, flash_hal_op_stats_t *stats) {
+    (void)op;
+    memset(stats, 0, sizeof(*stats));
+}
+
+void flash_hal_get_tag_stats(flash_hal_tag_t tag, flash_hal_op_t op, flash_hal_tag_stats_t *stats) {
+    (void)tag;
+    (void)op;
+    memset(stats, 0, sizeof(*stats));
+}
+
+void flash_hal_reset_stats(void) {
+}
+
+#endif // !FLASH_HAL_STATS
+
 int32_t flash_hal_erase(uint32_t addr, uint32_t size) {
+    FlashHalTag tag(FLASH_HAL_TAG_FS);
     if ((size & (SPI_FLASH_SEC_SIZE - 1)) != 0 ||
         (addr & (SPI_FLASH_SEC_SIZE - 1)) != 0) {
         DEBUGV("_spif_erase called with addr=%x, size=%d\r\n", addr, size);
@@ -59,6 +249,12 @@ int32_t flash_hal_erase(uint32_t addr, uint32_t size) {
     }
     const uint32_t sector = addr / SPI_FLASH_SEC_SIZE;
     const uint32_t sectorCount = size / SPI_FLASH_SEC_SIZE;
+#if FLASH_HAL_WRITE_COMBINING
+    if (s_page != NoPage && s_page >= addr && s_page < addr + size) {
+        // erased anyway
+        s_page = NoPage;
+    }
+#endif
     for (uint32_t i = 0; i < sectorCount; ++i) {
         optimistic_yield(10000);
         if (!ESP.flashEraseSector(sector + i)) {
@@ -91,8 +91,96 @@ extern int32_t flash_hal_write(uint32_t addr, uint32_t size, const uint8_t *src)
 extern int32_t flash_hal_erase(uint32_t addr, uint32_t size);
 extern int32_t flash_hal_read(uint32_t addr, uint32_t size, uint8_t *dst);
 
+// flash_hal_write() keeps the last page written to in RAM, so the pieces a
+// filesystem writes to one page (header, data, flags...) go to the chip in
+// a single program operation. The page is written when a write goes to
+// another page, a read covers it, or on flash_hal_flush(). Pieces landing
+// on bytes already pending are not merged, the chip sees them in order.
+#ifndef FLASH_HAL_WRITE_COMBINING
+#define FLASH_HAL_WRITE_COMBINING 1
+#endif
+
+extern int32_t flash_hal_flush(void);
+
+typedef struct {
+    uint32_t writes;    // flash_hal_write() calls
+    uint32_t bytes;     // bytes they wrote
+    uint32_t pieces;    // their per page pieces, what would be programmed without combining
+    uint32_t programs;  // program operations actually issued, pieces - programs were saved
+} flash_hal_write_stats_t;
+
+extern void flash_hal_get_write_stats(flash_hal_write_stats_t *stats);
+extern void flash_hal_reset_write_stats(void);
+
+// With FLASH_HAL_STATS, every spi_flash read, write and erase done by the
+// core (ESP.flashRead/flashWrite/flashEraseSector and what uses them) is
+// timed. Each operation type gets a log2 latency histogram, and time is
+// also summed per tag, the subsystem that was running: filesystems through
+// flash_hal are tagged FS, other layers set theirs with FlashHalTag.
+#ifndef FLASH_HAL_STATS
+#define FLASH_HAL_STATS 0
+#endif
+
+#define FLASH_HAL_STATS_BUCKETS 20
+
+typedef enum {
+    FLASH_HAL_OP_READ = 0,
+    FLASH_HAL_OP_WRITE,
+    FLASH_HAL_OP_ERASE,
+    FLASH_HAL_OPS
+} flash_hal_op_t;
+
+typedef enum {
+    FLASH_HAL_TAG_OTHER = 0,
+    FLASH_HAL_TAG_FS,
+    FLASH_HAL_TAG_UPDATER,
+    FLASH_HAL_TAG_EEPROM,
+    FLASH_HAL_TAG_USER,
+    FLASH_HAL_TAGS
+} flash_hal_tag_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t total_us;
+    uint32_t max_us;
+    // [0]: under 1us, [i]: 2^(i-1) to 2^i us, the last one everything above
+    uint32_t histogram[FLASH_HAL_STATS_BUCKETS];
+} flash_hal_op_stats_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t total_us;
+} flash_hal_tag_stats_t;
+
+// All of them are zero without FLASH_HAL_STATS
+extern void flash_hal_get_stats(flash_hal_op_t op, flash_hal_op_stats_t *stats);
+extern void flash_hal_get_tag_stats(flash_hal_tag_t tag, flash_hal_op_t op, flash_hal_tag_stats_t *stats);
+extern void flash_hal_reset_stats(void);
+
+// Returns the previous tag
+extern flash_hal_tag_t flash_hal_set_tag(flash_hal_tag_t tag);
+
+// Called by the core around each spi_flash operation
+extern void flash_hal_stats_record(flash_hal_op_t op, uint32_t bytes, uint32_t us);
+
 #ifdef __cplusplus
 } // extern "C"
+
+// Tags the flash operations done while in scope
+class FlashHalTag {
+public:
+#if FLASH_HAL_STATS
+    explicit FlashHalTag(flash_hal_tag_t tag) : _prev(flash_hal_set_tag(tag)) { }
+    ~FlashHalTag() { flash_hal_set_tag(_prev); }
+
+protected:
+    flash_hal_tag_t _prev;
+#else
+    explicit FlashHalTag(flash_hal_tag_t tag) { (void)tag; }
+#endif
+};
 #endif
 
 #endif // !defined(flash_hal_h)
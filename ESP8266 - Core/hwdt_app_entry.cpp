@@ -279,6 +279,7 @@
 #include <pgmspace.h>
 #include "umm_malloc/umm_malloc.h"
 #include "mmu_iram.h"
+#include "core_esp8266_crashlog.h"
 
 extern "C" {
 #include <user_interface.h>
@@ -546,6 +547,19 @@ STATIC const uint32_t * IRAM_MAYBE skip_stackguard(const uint32_t *start, const
     return uptr;
 }
 
+/*
+ * While a task runs, g_pcont is its cont_t from cont_create(). Accept one that
+ * sits in DRAM, 16 byte aligned just past its own heap block.
+ */
+static bool IRAM_MAYBE hwdt_is_task_cont(const cont_t *cont) {
+    const uintptr_t addr = (uintptr_t)cont;
+    if (addr < 0x3FFE8000UL || addr >= 0x40000000UL - sizeof(cont_t) || (addr & 15u)) {
+        return false;
+    }
+    const uintptr_t block = (uintptr_t)cont->heap_block;
+    return block && block <= addr && (addr - block) < 16u;
+}
+
 bool IRAM_MAYBE hwdt_check_g_pcont_validity(void) {
     /*
      * DRAM appears to remain valid after most resets. There is more on this in
@@ -557,7 +571,8 @@ bool IRAM_MAYBE hwdt_check_g_pcont_validity(void) {
     cont_t *noextra4k_g_pcont = get_noextra4k_g_pcont();
     if (g_rom_stack == ROM_STACK &&
         g_rom_stack_A16_sz == ROM_STACK_A16_SZ &&
-        g_pcont == ((noextra4k_g_pcont) ? noextra4k_g_pcont : CONT_STACK)
+        (g_pcont == ((noextra4k_g_pcont) ? noextra4k_g_pcont : CONT_STACK) ||
+         hwdt_is_task_cont(g_pcont))
         ) {
             hwdt_info.g_pcont_valid = true;
     } else {
@@ -856,17 +871,29 @@ uint32_t IRAM_MAYBE hwdt_cont_integrity_check() {
     if (g_pcont->stack_guard1 != CONT_STACKGUARD) {
       cont_integrity |= 0x0001;
     }
-    if (g_pcont->stack_guard2 != CONT_STACKGUARD) {
-      cont_integrity |= 0x0020;
-    }
-    if (g_pcont->stack_end != (g_pcont->stack + (sizeof(g_pcont->stack) / 4))) {
+    if (g_pcont->heap_block) {
+      // A task's stack has its own size, so there is nothing to repair
+      // stack_end with. Only check it stays in DRAM, and skip the rest
+      // and the stack dump when it does not.
+      const uintptr_t end = (uintptr_t)g_pcont->stack_end;
+      if (end <= (uintptr_t)g_pcont->stack || end > 0x40000000UL - 2 * sizeof(unsigned) || (end & 15u)) {
+        cont_integrity |= 0x0300;
+        hwdt_info.cont_integrity = cont_integrity;
+        return cont_integrity;
+      }
+    } else if (g_pcont->stack_end != (g_pcont->stack + (sizeof(g_pcont->stack) / 4))) {
       cont_integrity |= 0x0300;
       // Fix ending so we don't crash
       g_pcont->stack_end = (g_pcont->stack + (sizeof(g_pcont->stack) / 4));
     }
-    if (g_pcont->struct_start != (unsigned*)g_pcont) {
+    // stack_guard2 and struct_start follow the stack, read them through
+    // stack_end as cont_check() does
+    if (g_pcont->stack_end[0] != CONT_STACKGUARD) {
+      cont_integrity |= 0x0020;
+    }
+    if (g_pcont->stack_end[1] != (unsigned)g_pcont) {
       cont_integrity |= 0x4000;
-      g_pcont->struct_start = (unsigned*)g_pcont;
+      g_pcont->stack_end[1] = (unsigned)g_pcont;
     }
     hwdt_info.cont_integrity = cont_integrity;
     return cont_integrity;
@@ -920,10 +947,15 @@ STATIC void IRAM_MAYBE handle_hwdt(void) {
         // otherwise cause us to crash.
         hwdt_cont_integrity_check();
 
+        // A task's stack is never part of the SYS one. Without a trusted
+        // stack_end there are no bounds to dump it with.
+        const bool task_cont = (NULL != g_pcont->heap_block);
+        const bool cont_bounds = !task_cont || 0 == (hwdt_info.cont_integrity & 0x0300);
         const uint32_t *ctx_cont_ptr = NULL;
 #if !defined(DEBUG_ESP_HWDT_INFO)
-        if (get_noextra4k_g_pcont())
+        if (get_noextra4k_g_pcont() || task_cont)
 #endif
+        if (cont_bounds)
         {
             ctx_cont_ptr = skip_stackguard(g_pcont->stack, g_pcont->stack_end, CONT_STACKGUARD);
             hwdt_info.cont = (uintptr_t)g_pcont->stack_end - (uintptr_t)ctx_cont_ptr;
@@ -952,14 +984,16 @@ STATIC void IRAM_MAYBE handle_hwdt(void) {
 #endif
             /* Print context SYS */
             print_stack((uintptr_t)ctx_sys_ptr, (uintptr_t)ROM_STACK, PRINT_STACK::SYS);
-            if (get_noextra4k_g_pcont()) {
+            if (get_noextra4k_g_pcont() || task_cont) {
                 /* Print separate ctx: cont stack */
 
                 /* Check if cont stack is yielding to SYS */
                 if (0 == hwdt_info.cont_integrity && 0 != g_pcont->pc_suspend) {
                     ctx_cont_ptr = (const uint32_t *)((uintptr_t)g_pcont->sp_suspend - 8u);
                 }
-                print_stack((uintptr_t)ctx_cont_ptr, (uintptr_t)g_pcont->stack_end, PRINT_STACK::CONT);
+                if (cont_bounds) {
+                    print_stack((uintptr_t)ctx_cont_ptr, (uintptr_t)g_pcont->stack_end, PRINT_STACK::CONT);
+                }
             } else {
                 if (0 == hwdt_info.cont_integrity && 0 != g_pcont->pc_suspend) {
                     ETS_PRINTF("\nCont stack is yielding. Active stack starts at 0x%08X.\n", (uint32_t)g_pcont->sp_suspend - 8u);
@@ -969,6 +1003,19 @@ STATIC void IRAM_MAYBE handle_hwdt(void) {
             if (hwdt_info.cont_integrity) {
                 ETS_PRINTF("\nCaution, the stack is possibly corrupt integrity checks did not pass.\n\n");
             }
+
+            // Left in RTC memory for crashlog_boot(). The SDK isn't up, only
+            // the stacks can be looked at.
+            crashlog_record_t crash;
+            ets_memset(&crash, 0, sizeof(crash));
+            crash.reason = REASON_WDT_RST;
+            crash.sp = (uintptr_t)ctx_sys_ptr;
+            crashlog_add_trace(&crash, (uintptr_t)ctx_sys_ptr, (uintptr_t)ROM_STACK);
+            if (ctx_cont_ptr) {
+                crashlog_add_trace(&crash, (uintptr_t)ctx_cont_ptr, (uintptr_t)g_pcont->stack_end);
+                crash.cont_free_stack = (uintptr_t)ctx_cont_ptr - (uintptr_t)g_pcont->stack;
+            }
+            crashlog_save(&crash);
         }
     }
 
@@ -62,6 +62,8 @@ extern "C" {
 
 #define SPIFFS_ERR_SEEK_BOUNDS          -10040
 
+#define SPIFFS_ERR_FLASH_FLUSH          -10041
+
 
 #define SPIFFS_ERR_INTERNAL             -10050
 
@@ -482,6 +484,19 @@ s32_t SPIFFS_write(spiffs *fs, spiffs_file fh, void *buf, s32_t len);
  */
 s32_t SPIFFS_lseek(spiffs *fs, spiffs_file fh, s32_t offs, int whence);
 
+/**
+ * Finds where file data is stored in flash. Data pages start with a header,
+ * so the run given back ends at most at the end of the data page holding
+ * offs. The address stays valid until something is written to the file
+ * system, as garbage collection may move pages.
+ * @param fs            the file system struct
+ * @param fh            the filehandle
+ * @param offs          offset in the file
+ * @param addr          physical flash address of the data at offs
+ * @param len           number of file bytes stored from addr on
+ */
+s32_t SPIFFS_locate(spiffs *fs, spiffs_file fh, u32_t offs, u32_t *addr, u32_t *len);
+
 /**
  * Removes a file by path
  * @param fs            the file system struct
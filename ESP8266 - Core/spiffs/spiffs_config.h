@@ -212,6 +212,14 @@ typedef uint8_t u8_t;
 #ifndef SPIFFS_LOCK
 #define SPIFFS_LOCK(fs)
 #endif
+// flash_hal combines the writes to a page, they have to reach the chip
+// before an api call returns. The call's result can't change any more,
+// so a failure is left in err_code (SPIFFS_errno) for the caller.
+#ifndef SPIFFS_UNLOCK
+int32_t flash_hal_flush(void);
+#define SPIFFS_UNLOCK(fs) do { if (flash_hal_flush() != 0) { (fs)->err_code = SPIFFS_ERR_FLASH_FLUSH; } } while (0)
+#endif
+
 // define this to exit a mutex if you're running on a multithreaded system
 #ifndef SPIFFS_UNLOCK
 #define SPIFFS_UNLOCK(fs)
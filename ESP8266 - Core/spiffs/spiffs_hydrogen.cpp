@@ -649,6 +649,31 @@ s32_t SPIFFS_lseek(spiffs *fs, spiffs_file fh, s32_t offs, int whence) {
   return offs;
 }
 
+s32_t SPIFFS_locate(spiffs *fs, spiffs_file fh, u32_t offs, u32_t *addr, u32_t *len) {
+  SPIFFS_API_DBG("%s " _SPIPRIfd " " _SPIPRIi "\n", __func__, fh, offs);
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  spiffs_fd *fd;
+  s32_t res;
+  fh = SPIFFS_FH_UNOFFS(fs, fh);
+  res = spiffs_fd_get(fs, fh, &fd);
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+
+#if SPIFFS_CACHE_WR
+  // pending writes must be in flash for the address to mean anything
+  spiffs_fflush_cache(fs, fh);
+#endif
+
+  res = spiffs_object_locate(fd, offs, addr, len);
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+
+  SPIFFS_UNLOCK(fs);
+
+  return SPIFFS_OK;
+}
+
 s32_t SPIFFS_remove(spiffs *fs, const char *path) {
   SPIFFS_API_DBG("%s '%s'\n", __func__, path);
 #if SPIFFS_READ_ONLY
@@ -2067,6 +2067,62 @@ s32_t spiffs_object_read(
   return res;
 }
 
+// Finds where the data at offset is stored, without reading it. Gives the
+// physical address and how many bytes of the file follow there, which is
+// at most up to the end of the data page.
+s32_t spiffs_object_locate(
+    spiffs_fd *fd,
+    u32_t offset,
+    u32_t *addr,
+    u32_t *len) {
+  s32_t res = SPIFFS_OK;
+  spiffs *fs = fd->fs;
+  spiffs_page_ix objix_pix;
+  spiffs_page_ix data_pix;
+  spiffs_span_ix data_spix = offset / SPIFFS_DATA_PAGE_SIZE(fs);
+  spiffs_span_ix objix_spix = SPIFFS_OBJ_IX_ENTRY_SPAN_IX(fs, data_spix);
+
+  if (fd->size == SPIFFS_UNDEFINED_LEN || offset >= fd->size) {
+    return SPIFFS_ERR_END_OF_OBJECT;
+  }
+
+#if SPIFFS_IX_MAP
+  if (fd->ix_map && data_spix >= fd->ix_map->start_spix && data_spix <= fd->ix_map->end_spix
+      && fd->ix_map->map_buf[data_spix - fd->ix_map->start_spix]) {
+    data_pix = fd->ix_map->map_buf[data_spix - fd->ix_map->start_spix];
+  } else {
+#endif
+    if (objix_spix == 0) {
+      objix_pix = fd->objix_hdr_pix;
+    } else if (fd->cursor_objix_spix == objix_spix) {
+      objix_pix = fd->cursor_objix_pix;
+    } else {
+      res = spiffs_obj_lu_find_id_and_span(fs, fd->obj_id | SPIFFS_OBJ_ID_IX_FLAG, objix_spix, 0, &objix_pix);
+      SPIFFS_CHECK_RES(res);
+    }
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_IX | SPIFFS_OP_C_READ,
+        fd->file_nbr, SPIFFS_PAGE_TO_PADDR(fs, objix_pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->work);
+    SPIFFS_CHECK_RES(res);
+    if (objix_spix == 0) {
+      spiffs_page_object_ix_header *objix_hdr = (spiffs_page_object_ix_header *)fs->work;
+      SPIFFS_VALIDATE_OBJIX(objix_hdr->p_hdr, fd->obj_id, objix_spix);
+      data_pix = ((spiffs_page_ix*)((u8_t *)objix_hdr + sizeof(spiffs_page_object_ix_header)))[data_spix];
+    } else {
+      spiffs_page_object_ix *objix = (spiffs_page_object_ix *)fs->work;
+      SPIFFS_VALIDATE_OBJIX(objix->p_hdr, fd->obj_id, objix_spix);
+      data_pix = ((spiffs_page_ix*)((u8_t *)objix + sizeof(spiffs_page_object_ix)))[SPIFFS_OBJ_IX_ENTRY(fs, data_spix)];
+    }
+#if SPIFFS_IX_MAP
+  }
+#endif
+  res = spiffs_page_data_check(fs, fd, data_pix, data_spix);
+  SPIFFS_CHECK_RES(res);
+
+  *addr = SPIFFS_PAGE_TO_PADDR(fs, data_pix) + sizeof(spiffs_page_header) + (offset % SPIFFS_DATA_PAGE_SIZE(fs));
+  *len = MIN(SPIFFS_DATA_PAGE_SIZE(fs) - (offset % SPIFFS_DATA_PAGE_SIZE(fs)), fd->size - offset);
+  return SPIFFS_OK;
+}
+
 #if !SPIFFS_READ_ONLY
 typedef struct {
   spiffs_obj_id min_obj_id;
@@ -734,6 +734,12 @@ s32_t spiffs_object_read(
     u32_t len,
     u8_t *dst);
 
+s32_t spiffs_object_locate(
+    spiffs_fd *fd,
+    u32_t offset,
+    u32_t *addr,
+    u32_t *len);
+
 s32_t spiffs_object_truncate(
     spiffs_fd *fd,
     u32_t new_len,
@@ -24,7 +24,9 @@
  License along with this library; if not, write to the Free Software
  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
+#include <algorithm>
 #include <limits>
+#include <new>
 #include "FS.h"
 #include "FSImpl.h"
 extern "C" {
@@ -379,35 +381,103 @@ public:
     {
         CHECKFD();
 
+        _dropPeek();
+        SPIFFS_clearerr(_fs->getFs());
         auto result = SPIFFS_write(_fs->getFs(), _fd, (void*) buf, size);
         if (result < 0) {
             DEBUGV("SPIFFS_write rc=%d\r\n", result);
             return 0;
         }
         _written = true;
+        if (_flushFailed()) {
+            return 0;
+        }
         return result;
     }
 
     int Read(uint8_t* buf, size_t size) override
     {
         CHECKFD();
-        int result = SPIFFS_read(_fs->getFs(), _fd, (void*) buf, size);
+
+        // what's left in the peek buffer comes first
+        size_t done = std::min(size, _peekLen - _peekPos);
+        if (done) {
+            memcpy(buf, _peekBuf.get() + _peekPos, done);
+            _peekPos += done;
+            if (done == size) {
+                return done;
+            }
+        }
+
+        int result = SPIFFS_read(_fs->getFs(), _fd, (void*) (buf + done), size - done);
         if (result < 0) {
             DEBUGV("SPIFFS_read rc=%d\r\n", result);
+            return done;
+        }
+
+        return done + result;
+    }
+
+    int AvailableForWrite() override
+    {
+        CHECKFD();
+
+        uint32_t totalBytes, usedBytes;
+        auto rc = SPIFFS_info(_fs->getFs(), &totalBytes, &usedBytes);
+        if (rc != SPIFFS_OK || usedBytes >= totalBytes) {
             return 0;
         }
+        return totalBytes - usedBytes;
+    }
 
-        return result;
+    // Reads one logical page at a time, so Stream::Send*() copies whole
+    // pages straight from it
+    bool HasPeekBufferAPI() const override
+    {
+        return true;
+    }
+
+    size_t PeekAvailable() override
+    {
+        CHECKFD();
+
+        if (_peekPos == _peekLen) {
+            _peekPos = _peekLen = 0;
+            if (!_peekBuf) {
+                _peekBuf.reset(new (std::nothrow) uint8_t[_fs->_pageSize]);
+                if (!_peekBuf) {
+                    return 0;
+                }
+            }
+            int result = SPIFFS_read(_fs->getFs(), _fd, (void*) _peekBuf.get(), _fs->_pageSize);
+            if (result > 0) {
+                _peekLen = result;
+            }
+        }
+        return _peekLen - _peekPos;
+    }
+
+    const char* PeekBuffer() override
+    {
+        return (const char*) _peekBuf.get() + _peekPos;
+    }
+
+    void PeekConsume(size_t consume) override
+    {
+        _peekPos += std::min(consume, _peekLen - _peekPos);
     }
 
     void Flush() override
     {
         CHECKFD();
 
+        SPIFFS_clearerr(_fs->getFs());
         auto rc = SPIFFS_fflush(_fs->getFs(), _fd);
         if (rc < 0) {
             DEBUGV("SPIFFS_fflush rc=%d\r\n", rc);
+            _writeError = true;
         }
+        _flushFailed();
         _written = true;
     }
 
@@ -415,6 +485,7 @@ public:
     {
         CHECKFD();
 
+        _dropPeek();
         int32_t offset = static_cast<int32_t>(pos);
         if (mode == SeekEnd) {
             offset = -offset;
@@ -438,7 +509,8 @@ public:
             return 0;
         }
 
-        return result;
+        // SPIFFS is ahead by what the peek buffer still holds
+        return result - (_peekLen - _peekPos);
     }
 
     size_t Size() const override
@@ -453,14 +525,43 @@ public:
     bool Truncate(uint32_t size) override
     {
         CHECKFD();
+        _dropPeek();
         spiffs_fd *sfd;
         if (spiffs_fd_get(_fs->getFs(), _fd, &sfd) == SPIFFS_OK) {
-            return SPIFFS_OK == spiffs_object_truncate(sfd, size, 0);
+            if (SPIFFS_OK != spiffs_object_truncate(sfd, size, 0)) {
+                return false;
+            }
+            // not a SPIFFS api call, nothing flushed flash_hal on the way out
+            if (flash_hal_flush() != FLASH_HAL_OK) {
+                _writeError = true;
+                return false;
+            }
+            return true;
         } else {
           return false;
         }
     }
 
+    bool GetWriteError() const override
+    {
+        return _writeError;
+    }
+
+    bool GetSpan(size_t pos, uint32_t& address, size_t& length) override
+    {
+        CHECKFD();
+
+        // data pages start with a header, so a span ends with its page
+        uint32_t len;
+        auto rc = SPIFFS_locate(_fs->getFs(), _fd, pos, &address, &len);
+        if (rc != SPIFFS_OK) {
+            DEBUGV("SPIFFS_locate rc=%d\r\n", rc);
+            return false;
+        }
+        length = len;
+        return true;
+    }
+
     bool IsFile() const override
     {
         // No such thing as directories on SPIFFS
@@ -477,7 +578,9 @@ public:
     {
         CHECKFD();
 
+        SPIFFS_clearerr(_fs->getFs());
         SPIFFS_close(_fs->getFs(), _fd);
+        _flushFailed();
         DEBUGV("SPIFFS_close: fd=%d\r\n", _fd);
     }
 
@@ -505,10 +608,42 @@ protected:
         _written = false;
     }
 
+    // SPIFFS_UNLOCK writes out what flash_hal still holds, a failure there
+    // only shows in err_code
+    bool _flushFailed()
+    {
+        if (SPIFFS_errno(_fs->getFs()) != SPIFFS_ERR_FLASH_FLUSH) {
+            return false;
+        }
+        DEBUGV("SPIFFS: flash_hal_flush failed\r\n");
+        SPIFFS_clearerr(_fs->getFs());
+        _writeError = true;
+        return true;
+    }
+
+    // Moves SPIFFS back to the logical position, before anything that
+    // doesn't go through the peek buffer
+    void _dropPeek()
+    {
+        size_t ahead = _peekLen - _peekPos;
+        _peekPos = _peekLen = 0;
+        if (ahead) {
+            auto rc = SPIFFS_lseek(_fs->getFs(), _fd, -(int32_t) ahead, SPIFFS_SEEK_CUR);
+            if (rc < 0) {
+                DEBUGV("SPIFFS_lseek rc=%d\r\n", rc);
+            }
+        }
+    }
+
     SPIFFSImpl* _fs;
     spiffs_file _fd;
     mutable spiffs_stat _stat;
     mutable bool        _written;
+    bool                _writeError = false;
+
+    std::unique_ptr<uint8_t[]> _peekBuf;
+    size_t _peekPos = 0;
+    size_t _peekLen = 0;
 };
 
 class SPIFFSDirImpl : public DirImpl
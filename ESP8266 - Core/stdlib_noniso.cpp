@@ -19,23 +19,156 @@
   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include <string.h>
+#include <pgmspace.h>
+
 #include "stdlib_noniso.h"
 
-// ulltoa() is slower than std::to_char() (1.6 times)
-// but is smaller by ~800B/flash and ~250B/rodata
+namespace {
+
+// "00" to "99", kept in flash and read a pair (one aligned 16 bit word) at a time
+const char digitPairs[201] PROGMEM __attribute__((aligned(4))) =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// v / 100 for any 32 bit v, without a divide
+inline uint32_t div100(uint32_t v)
+{
+    return (uint32_t)(((uint64_t)v * 0x51EB851FULL) >> 37);
+}
+
+// High half of the 128 bit product a * b
+inline uint64_t umulh64(uint64_t a, uint64_t b)
+{
+    const uint64_t lo = (uint64_t)(uint32_t)a * (uint32_t)b;
+    const uint64_t m1 = (uint64_t)(uint32_t)a * (uint32_t)(b >> 32);
+    const uint64_t m2 = (uint64_t)(uint32_t)(a >> 32) * (uint32_t)b;
+    const uint64_t hi = (uint64_t)(uint32_t)(a >> 32) * (uint32_t)(b >> 32);
+    const uint64_t mid = (lo >> 32) + (uint32_t)m1 + (uint32_t)m2;
+    return hi + (m1 >> 32) + (m2 >> 32) + (mid >> 32);
+}
+
+// v / 100000000 for any 64 bit v, without a divide: (v / 2^8) / 5^8
+inline uint64_t div1e8(uint64_t v)
+{
+    return umulh64(v >> 8, 0xABCC77118461CEFDULL) >> 18;
+}
+
+inline void put_pair(char* out, uint32_t r)
+{
+    const uint16_t pair = pgm_read_word(&digitPairs[r * 2]);
+    out[0] = (char)pair;
+    out[1] = (char)(pair >> 8);
+}
+
+char* put_dec32(uint32_t v, char* end)
+{
+    while (v >= 100)
+    {
+        const uint32_t q = div100(v);
+        end -= 2;
+        put_pair(end, v - q * 100);
+        v = q;
+    }
+    if (v >= 10)
+    {
+        end -= 2;
+        put_pair(end, v);
+    }
+    else
+    {
+        *--end = '0' + v;
+    }
+    return end;
+}
+
+// Exactly 8 digits, with leading zeros
+char* put_dec8(uint32_t v, char* end)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        const uint32_t q = div100(v);
+        end -= 2;
+        put_pair(end, v - q * 100);
+        v = q;
+    }
+    return end;
+}
+
+template <typename T>
+char* put_radix(T val, char* end, unsigned int radix, bool upper)
+{
+    const char a = upper ? 'A' : 'a';
+    if (!(radix & (radix - 1)))
+    {
+        const unsigned int shift = __builtin_ctz(radix);
+        const T mask = radix - 1;
+        do
+        {
+            const unsigned int c = val & mask;
+            *--end = c < 10 ? c + '0' : c + a - 10;
+            val >>= shift;
+        } while (val);
+        return end;
+    }
+    do
+    {
+        const T q = val / radix;
+        const unsigned int c = val - q * radix;
+        *--end = c < 10 ? c + '0' : c + a - 10;
+        val = q;
+    } while (val);
+    return end;
+}
+
+} // namespace
+
+char* utoa_backwards(uint32_t val, char* end, unsigned int radix, bool upper)
+{
+    if (radix == 10)
+    {
+        return put_dec32(val, end);
+    }
+    return put_radix(val, end, radix, upper);
+}
+
+char* ulltoa_backwards(uint64_t val, char* end, unsigned int radix, bool upper)
+{
+    if (radix == 10)
+    {
+        while (val > UINT32_MAX)
+        {
+            const uint64_t q = div1e8(val);
+            end = put_dec8((uint32_t)(val - q * 100000000), end);
+            val = q;
+        }
+        return put_dec32((uint32_t)val, end);
+    }
+    if (val <= UINT32_MAX)
+    {
+        return put_radix((uint32_t)val, end, radix, upper);
+    }
+    return put_radix(val, end, radix, upper);
+}
 
 // ulltoa fills str backwards and can return a pointer different from str
 char* ulltoa(unsigned long long val, char* str, int slen, unsigned int radix)
 {
-    str += --slen;
-    *str = 0;
-    do
+    char buf[64];
+    char* end = buf + sizeof(buf);
+    char* digits = ulltoa_backwards(val, end, radix, false);
+    const int len = end - digits;
+    if (len >= slen)
     {
-        auto mod = val % radix;
-        val /= radix;
-        *--str = mod + ((mod > 9) ? ('a' - 10) : '0');
-    } while (--slen && val);
-    return val? nullptr: str;
+        return nullptr;
+    }
+    str += slen - 1 - len;
+    memcpy(str, digits, len);
+    str[len] = 0;
+    return str;
 }
 
 // lltoa fills str backwards and can return a pointer different from str
@@ -22,6 +22,9 @@
 #ifndef STDLIB_NONISO_H
 #define STDLIB_NONISO_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C"{
 #endif
@@ -46,6 +49,13 @@ char* ulltoa (unsigned long long val, char* str, int slen, unsigned int radix);
 
 char* dtostrf (double val, signed char width, unsigned char prec, char *s);
 
+// Fill the digits of val backwards, ending just before end (no terminator),
+// and return a pointer to the first one. Base 10 and powers of two don't
+// divide; digits above 9 are 'A' or 'a' depending on upper.
+char* utoa_backwards (uint32_t val, char* end, unsigned int radix, bool upper);
+
+char* ulltoa_backwards (uint64_t val, char* end, unsigned int radix, bool upper);
+
 void reverse(char* Begin, char* end);
 
 const char* strrstr(const char*__restrict p_pcString,
@@ -37,6 +37,36 @@ extern "C" {
 #define TWI_BUFFER_LENGTH 32
 #endif
 
+// Number of bytes (address or data) clocked per scheduler slice by the transaction queue
+#ifndef TWI_QUEUE_SLICE_BYTES
+#define TWI_QUEUE_SLICE_BYTES 4
+#endif
+
+#define TWI_PENDING 0xFF
+
+// One START (or repeated START), address and data phase of a queued transaction.  status uses
+// the twi_writeTo() codes: 0 ok, 2 address NACK, 3 data NACK, 4 line busy, or TWI_PENDING.
+typedef struct twi_segment
+{
+    uint8_t  address;  // 7 bit slave address
+    uint8_t  read;     // nonzero to read len bytes into buf, else write len bytes from buf
+    uint8_t  stop;     // nonzero to send STOP after this segment, else repeated START
+    uint8_t  status;
+    uint8_t* buf;
+    uint16_t len;
+} twi_segment_t;
+
+// Caller owned, must stay valid until done() is called. done() runs from the scheduler with
+// the status of the segment that ended the transaction; a failing segment aborts the rest.
+typedef struct twi_transaction
+{
+    twi_segment_t* segments;
+    uint8_t        count;
+    void (*done)(struct twi_transaction*, uint8_t status);
+    void*                   arg;
+    struct twi_transaction* next;  // internal
+} twi_transaction_t;
+
 void twi_init(unsigned char sda, unsigned char scl);
 void twi_setAddress(uint8_t);
 void twi_stop(void);
@@ -46,6 +76,9 @@ uint8_t twi_writeTo(unsigned char address, unsigned char * buf, unsigned int len
 uint8_t twi_readFrom(unsigned char address, unsigned char * buf, unsigned int len, unsigned char sendStop);
 uint8_t twi_status();
 
+bool   twi_queue(twi_transaction_t* transaction);
+size_t twi_queuePending(void);
+
 uint8_t twi_transmit(const uint8_t*, uint8_t);
 
 void twi_attachSlaveRxEvent(void (*)(uint8_t*, size_t));
@@ -0,0 +1,261 @@
+#include "FanInput.h"
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+FanInputClass FANINPUT;
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+void ICACHE_RAM_ATTR FanInputClass::ButtonISR(void* Arg)
+{
+    FanInputClass* Input = (FanInputClass*)Arg;
+
+    //  Only note the edge, the level is sampled once it has been stable for FANINPUT_DEBOUNCE_MS
+    Input->_EdgeTime = millis();
+
+    Input->_Edge = true;
+}
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+void FanInputClass::Begin(MODE_CONTROL_t Mode)
+{
+    this->_Mode = Mode;
+
+    this->_Buttons = 0;
+
+    this->_RF = NULL;
+
+    this->_RFCodes = 0;
+
+    this->_RFLastCode = 0;
+
+    this->_ADCLevel = -1;
+
+    this->_ADCLastTime = millis();
+
+    this->_Head = 0;
+
+    this->_Count = 0;
+
+    this->_LastFREQ = 0;
+
+    //  Evaluate the initial button levels once
+    this->_EdgeTime = millis();
+
+    this->_Edge = true;
+}
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+bool FanInputClass::AddButton(uint8_t Pin, uint32_t FREQ_)
+{
+    if(this->_Buttons >= FANINPUT_MAX_BUTTONS) return false;
+
+    pinMode(Pin, INPUT);
+
+    this->_ButtonPin[this->_Buttons] = Pin;
+
+    this->_ButtonFREQ[this->_Buttons] = FREQ_;
+
+    this->_Buttons++;
+
+    if(this->_Mode == MODE_BUTTON)
+    {
+        attachInterruptArg(digitalPinToInterrupt(Pin), ButtonISR, this, CHANGE);
+    }
+
+    return true;
+}
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+bool FanInputClass::AddRFCode(unsigned long Code, uint32_t FREQ_)
+{
+    if(this->_RFCodes >= FANINPUT_MAX_RF_CODES) return false;
+
+    this->_RFCode[this->_RFCodes] = Code;
+
+    this->_RFFREQ[this->_RFCodes] = FREQ_;
+
+    this->_RFCodes++;
+
+    return true;
+}
+
+void FanInputClass::BeginRF(RCSwitch* Receiver)
+{
+    this->_RF = Receiver;
+}
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+void FanInputClass::Push(uint32_t FREQ_, uint32_t Now)
+{
+    if(FREQ_ == this->_LastFREQ) return;
+
+    this->_LastFREQ = FREQ_;
+
+    //  When full the oldest event is dropped, only the latest request matters to the fan
+    if(this->_Count == FANINPUT_QUEUE_SIZE)
+    {
+        this->_Head = (this->_Head + 1) % FANINPUT_QUEUE_SIZE;
+
+        this->_Count--;
+    }
+
+    FanEvent_t* Event = &this->_Queue[(this->_Head + this->_Count) % FANINPUT_QUEUE_SIZE];
+
+    Event->FREQ = FREQ_;
+
+    Event->Source = this->_Mode;
+
+    Event->Time = Now;
+
+    this->_Count++;
+}
+
+bool FanInputClass::Read(FanEvent_t* Event)
+{
+    if(this->_Count == 0) return false;
+
+    *Event = this->_Queue[this->_Head];
+
+    this->_Head = (this->_Head + 1) % FANINPUT_QUEUE_SIZE;
+
+    this->_Count--;
+
+    return true;
+}
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+void FanInputClass::HandleButton(uint32_t Now)
+{
+    if(!this->_Edge) return;
+
+    if((int32_t)(Now - this->_EdgeTime) < (int32_t)FANINPUT_DEBOUNCE_MS) return;
+
+    noInterrupts();
+
+    //  An edge may have come in since the check above, it restarts the debounce. Its
+    //  _EdgeTime can be later than Now, hence the signed compare
+    if((int32_t)(Now - this->_EdgeTime) < (int32_t)FANINPUT_DEBOUNCE_MS)
+    {
+        interrupts();
+
+        return;
+    }
+
+    this->_Edge = false;
+
+    interrupts();
+
+    //  First pressed button wins, none pressed stops the fan
+    uint32_t FREQ_ = 0;
+
+    for(uint8_t i = 0; i < this->_Buttons; i++)
+    {
+        if(digitalRead(this->_ButtonPin[i]) == LOW)
+        {
+            FREQ_ = this->_ButtonFREQ[i];
+
+            break;
+        }
+    }
+
+    this->Push(FREQ_, Now);
+}
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+void FanInputClass::HandleRF(uint32_t Now)
+{
+    if((this->_RF == NULL) || !this->_RF->available()) return;
+
+    unsigned long Code = this->_RF->getReceivedValue();
+
+    this->_RF->resetAvailable();
+
+    //  A held remote repeats its code, only the first frame counts
+    bool Repeat = (Code == this->_RFLastCode) && ((Now - this->_RFLastTime) < FANINPUT_RF_HOLD_MS);
+
+    this->_RFLastCode = Code;
+
+    this->_RFLastTime = Now;
+
+    if(Repeat) return;
+
+    for(uint8_t i = 0; i < this->_RFCodes; i++)
+    {
+        if(this->_RFCode[i] == Code)
+        {
+            //  Pressing the running speed again stops the fan
+            this->Push((this->_LastFREQ == this->_RFFREQ[i]) ? 0 : this->_RFFREQ[i], Now);
+
+            break;
+        }
+    }
+}
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+void FanInputClass::HandleADC(uint32_t Now)
+{
+    if((Now - this->_ADCLastTime) < FANINPUT_ADC_PERIOD_MS) return;
+
+    this->_ADCLastTime = Now;
+
+    int Level = analogRead(A0);
+
+    if((this->_ADCLevel >= 0) && (abs(Level - this->_ADCLevel) < FANINPUT_ADC_HYST)) return;
+
+    this->_ADCLevel = Level;
+
+    uint32_t FREQ_ = 0;
+
+    if(Level >= FANINPUT_ADC_OFF)
+    {
+        FREQ_ = RAMP_MIN_FREQ + ((uint32_t)(Level - FANINPUT_ADC_OFF) * (MAXFREQ - RAMP_MIN_FREQ)) / (1023 - FANINPUT_ADC_OFF);
+    }
+
+    this->Push(FREQ_, Now);
+}
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+void FanInputClass::Handle(void)
+{
+    uint32_t Now = millis();
+
+    switch(this->_Mode)
+    {
+        case MODE_BUTTON:
+
+            this->HandleButton(Now);
+
+            break;
+
+        case MODE_RF:
+
+            this->HandleRF(Now);
+
+            break;
+
+        case MODE_ADC:
+
+            this->HandleADC(Now);
+
+            break;
+    }
+}
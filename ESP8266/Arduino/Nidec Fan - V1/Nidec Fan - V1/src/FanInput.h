@@ -0,0 +1,155 @@
+#ifndef _FAN_INPUT_H_
+#define _FAN_INPUT_H_
+
+#include <Arduino.h>
+
+#include "RCSwitch.h"
+
+#include "Nidec.h"
+
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+#define FANINPUT_MAX_BUTTONS                            4
+
+#define FANINPUT_MAX_RF_CODES                           4
+
+#define FANINPUT_QUEUE_SIZE                             8
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+#define FANINPUT_DEBOUNCE_MS                            50              //      Level must be stable this long after the last edge
+
+#define FANINPUT_RF_HOLD_MS                             300             //      Repeats of the same RF code within this are one press
+
+#define FANINPUT_ADC_PERIOD_MS                          50
+
+#define FANINPUT_ADC_HYST                               16              //      ADC counts
+
+#define FANINPUT_ADC_OFF                                32              //      Below this the fan is stopped
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+typedef struct
+{
+    uint32_t                                            FREQ;
+
+    MODE_CONTROL_t                                      Source;
+
+    uint32_t                                            Time;           //      millis() when the input settled
+}
+FanEvent_t;
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+
+class FanInputClass
+{
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/    
+    private:
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+        MODE_CONTROL_t                                  _Mode;
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+        uint8_t                                         _ButtonPin[FANINPUT_MAX_BUTTONS];
+
+        uint32_t                                        _ButtonFREQ[FANINPUT_MAX_BUTTONS];
+
+        uint8_t                                         _Buttons;
+
+        volatile uint8_t                                _Edge;
+
+        volatile uint32_t                               _EdgeTime;
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+        RCSwitch*                                       _RF;
+
+        unsigned long                                   _RFCode[FANINPUT_MAX_RF_CODES];
+
+        uint32_t                                        _RFFREQ[FANINPUT_MAX_RF_CODES];
+
+        uint8_t                                         _RFCodes;
+
+        unsigned long                                   _RFLastCode;
+
+        uint32_t                                        _RFLastTime;
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+        uint32_t                                        _ADCLastTime;
+
+        int                                             _ADCLevel;
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+        FanEvent_t                                      _Queue[FANINPUT_QUEUE_SIZE];
+
+        uint8_t                                         _Head;
+
+        uint8_t                                         _Count;
+
+        uint32_t                                        _LastFREQ;
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+        void                                            Push(uint32_t FREQ_, uint32_t Now);
+
+        void                                            HandleButton(uint32_t Now);
+
+        void                                            HandleRF(uint32_t Now);
+
+        void                                            HandleADC(uint32_t Now);
+
+        static void ICACHE_RAM_ATTR                     ButtonISR(void* Arg);
+
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+    public:
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+        void                                            Begin(MODE_CONTROL_t Mode);
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+        bool                                            AddButton(uint8_t Pin, uint32_t FREQ_);     //      Active low
+
+        bool                                            AddRFCode(unsigned long Code, uint32_t FREQ_);
+
+        void                                            BeginRF(RCSwitch* Receiver);
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+        void                                            Handle(void);                               //      Call from loop()
+
+        bool                                            Read(FanEvent_t* Event);
+
+
+
+
+};
+
+extern FanInputClass FANINPUT;
+
+
+#endif
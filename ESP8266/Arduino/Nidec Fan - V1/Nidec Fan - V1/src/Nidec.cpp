@@ -8,25 +8,7 @@ NidecClass NIDEC;
 /******************************************************************************************************************************
 						
 ******************************************************************************************************************************/
-os_timer_t TimerTick;
-
-/******************************************************************************************************************************
-						
-******************************************************************************************************************************/
-void ICACHE_RAM_ATTR TimerPWMFunc(void) 
-{
-    NIDEC.HandlePWM();
-}
-
-void ICACHE_RAM_ATTR TimerTickFunc(void)    
-{
-   NIDEC.HandleTICK();
-}
-
-/******************************************************************************************************************************
-						
-******************************************************************************************************************************/
-void NidecClass::Begin(uint8_t PWMPin, uint8_t BreakPin)
+void NidecClass::Begin(uint8_t PWMPin, uint8_t BreakPin, RAMP_PROFILE_t Profile, uint16_t Accel)
 {
     #ifdef DEBUG_NIDEC
 
@@ -40,23 +22,29 @@ void NidecClass::Begin(uint8_t PWMPin, uint8_t BreakPin)
 
     pinMode(BreakPin, OUTPUT);
 
+    digitalWrite(PWMPin, LOW);
+
     this->_PWMPin = PWMPin;
 
     this->_BreakPin = BreakPin;
 
     this->_CurrentFREQ = 0;
 
-    this->_FREQDir = FREQ_INC;
-
-
-    timer1_attachInterrupt(TimerPWMFunc);
+    this->_FREQ = 0;
 
-    timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);   //  5 Tick/us
+    this->_FREQDir = FREQ_INC;
 
+    this->Profile(Profile, Accel);
+}
 
-    os_timer_disarm(&TimerTick);
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+void NidecClass::Profile(RAMP_PROFILE_t Profile, uint16_t Accel)
+{
+    this->_Profile = Profile;
 
-	os_timer_setfn(&TimerTick, (os_timer_func_t *)TimerTickFunc, (void *) 0);
+    this->_Accel = (Accel == 0) ? 1 : Accel;
 }
 
 /******************************************************************************************************************************
@@ -64,23 +52,62 @@ void NidecClass::Begin(uint8_t PWMPin, uint8_t BreakPin)
 ******************************************************************************************************************************/
 void NidecClass::FREQ(uint32_t FREQ_)
 {
-    if(FREQ_ == 0) return;
-
     if(FREQ_ > MAXFREQ) return;
 
-    this->_Reload = 2500000 / FREQ_;
+    this->_CurrentFREQ = FREQ_;
 
-    #ifdef DEBUG_NIDEC
+    if(FREQ_ == 0)
+    {
+        stopWaveform(this->_PWMPin);
 
-    Serial.print("Reload Value: ");
+        digitalWrite(this->_PWMPin, LOW);
 
-    Serial.println(this->_Reload);
+        digitalWrite(this->_BreakPin, HIGH);
 
-    Serial.println();
+        #ifdef DEBUG_NIDEC
+
+        Serial.println("Turn Off");
+
+        #endif
+
+        return;
+    }
+
+    //  The waveform generator switches to the new period on the next rising edge, without a glitch
+    uint32_t Period = microsecondsToClockCycles(1000000UL) / FREQ_;
+
+    startWaveformClockCycles(this->_PWMPin, Period / 2, Period - Period / 2, 0);
+
+    #ifdef DEBUG_NIDEC
+
+    Serial.print("Current Frequency: ");
+
+    Serial.println(this->_CurrentFREQ);
 
     #endif
+}
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+uint32_t NidecClass::RampFREQ(uint32_t Elapsed)
+{
+    if(Elapsed >= this->_RampTime) return this->_FREQ;
+
+    //  Progress along the ramp, 0..65536
+    uint32_t X = ((uint64_t)Elapsed << 16) / this->_RampTime;
+
+    if(this->_Profile == RAMP_SCURVE)
+    {
+        //  3x^2 - 2x^3, same duration as the linear ramp with 1.5x its acceleration at mid-ramp
+        uint64_t X2 = ((uint64_t)X * X) >> 16;
+
+        X = (X2 * (3 * 65536 - 2 * X)) >> 16;
+    }
+
+    int32_t Delta = (int32_t)this->_FREQ - (int32_t)this->_StartFREQ;
 
-    timer1_write(this->_Reload); 
+    return this->_StartFREQ + (int32_t)(((int64_t)Delta * X) >> 16);
 }
 
 /******************************************************************************************************************************
@@ -114,45 +141,47 @@ void NidecClass::Start(uint32_t FREQ_)
 
     #endif
 
-    if(this->_FREQ != FREQ_)
-    {
-        this->_FREQ = FREQ_;
+    if(FREQ_ > MAXFREQ) FREQ_ = MAXFREQ;
+
+    if((FREQ_ != 0) && (FREQ_ < RAMP_MIN_FREQ)) FREQ_ = RAMP_MIN_FREQ;
 
+    if(this->_FREQ == FREQ_) return;
+
+    this->_FREQ = FREQ_;
+
+    //  A new target while ramping carries on from wherever the fan is now
+    if(this->_CurrentFREQ == 0)
+    {
         digitalWrite(this->_BreakPin, LOW);
 
-        if(this->_CurrentFREQ < this->_FREQ)
-        {
-            this->_CurrentFREQ += PWMSTEP;
+        this->FREQ(RAMP_MIN_FREQ);
+    }
 
-            this->_FREQDir = FREQ_INC;
-        }
-        else
-        {
-            this->_CurrentFREQ -= PWMSTEP;
+    this->_StartFREQ = this->_CurrentFREQ;
 
-            this->_FREQDir = FREQ_DEC;
-        }
-        
-        os_timer_arm(&TimerTick, 1000, 1);
+    this->_FREQDir = (this->_FREQ > this->_StartFREQ) ? FREQ_INC : FREQ_DEC;
 
-        #ifdef DEBUG_NIDEC
+    uint32_t Span = (this->_FREQDir == FREQ_INC) ? (this->_FREQ - this->_StartFREQ) : (this->_StartFREQ - this->_FREQ);
 
-        Serial.println("Tick Enable");
+    this->_RampTime = (Span * 1000UL) / this->_Accel;
 
-        Serial.print("Frequency: ");
+    this->_RampStart = millis();
 
-        Serial.println(this->_FREQ);
+    this->_LastUpdate = this->_RampStart;
 
-        Serial.print("Current Frequency: ");
+    #ifdef DEBUG_NIDEC
 
-        Serial.println(this->_CurrentFREQ);
+    Serial.print("Frequency: ");
 
-        Serial.println();
+    Serial.println(this->_FREQ);
 
-        #endif
+    Serial.print("Ramp Time: ");
 
-        this->FREQ(this->_CurrentFREQ);
-    }
+    Serial.println(this->_RampTime);
+
+    Serial.println();
+
+    #endif
 }
 
 /******************************************************************************************************************************
@@ -166,112 +195,37 @@ void NidecClass::Stop(void)
 /******************************************************************************************************************************
 						
 ******************************************************************************************************************************/
-void NidecClass::HandlePWM(void)
-{
-    if(this->_State == HIGH)
-    {
-        this->_State = LOW;
-    }
-    else 
-    {
-        this->_State = HIGH;
-    }
-    
-    digitalWrite(this->_PWMPin, this->_State);  
-
-    timer1_write(this->_Reload);
-}
-
-/******************************************************************************************************************************
-						
-******************************************************************************************************************************/
-void NidecClass::HandleTICK(void)
+void NidecClass::Handle(void)
 {
-    if(this->_FREQDir == FREQ_INC)
-    {
-        this->_CurrentFREQ += PWMSTEP;
-
-        if(this->_CurrentFREQ > this->_FREQ) 
-        {
-            os_timer_disarm(&TimerTick);
-
-            #ifdef DEBUG_NIDEC
-
-            Serial.println("Tick Disable");
-
-            #endif
-        }
-        else
-        {
-            #ifdef DEBUG_NIDEC
-
-            Serial.print("Frequency: ");
-
-            Serial.println(this->_FREQ);
-
-            Serial.print("Current Frequency: ");
-
-            Serial.println(this->_CurrentFREQ);
-
-            Serial.println();
-
-            #endif
-            
-            this->FREQ(this->_CurrentFREQ);
-        } 
-    }
-    else
-    {
-        this->_CurrentFREQ -= PWMSTEP;
-
-        if(this->_CurrentFREQ < this->_FREQ) 
-        {
-            os_timer_disarm(&TimerTick);
-        }
-        else
-        {
-            #ifdef DEBUG_NIDEC
+    if(this->_CurrentFREQ == this->_FREQ) return;
 
-            Serial.print("Frequency: ");
+    uint32_t Now = millis();
 
-            Serial.println(this->_FREQ);
+    //  Never step faster than the output period, so the previous change has been applied by the generator
+    uint32_t Interval = (this->_CurrentFREQ != 0) ? (1000UL / this->_CurrentFREQ + 1) : 0;
 
-            Serial.print("Current Frequency: ");
+    if(Interval < RAMP_TICK_MS) Interval = RAMP_TICK_MS;
 
-            Serial.println(this->_CurrentFREQ);
+    if((Now - this->_LastUpdate) < Interval) return;
 
-            Serial.println();
-
-            #endif
-
-            if(this->_CurrentFREQ == 0)
-            {
-                digitalWrite(this->_BreakPin, HIGH);
-
-                os_timer_disarm(&TimerTick);
-
-                #ifdef DEBUG_NIDEC
-
-                Serial.println("Tick Disable And Turn Off");
-
-                #endif
-            }
-            else
-            {
-                this->FREQ(this->_CurrentFREQ);
-            }
-        }
-    } 
+    this->_LastUpdate = Now;
 
-    
+    uint32_t NewFREQ = this->RampFREQ(Now - this->_RampStart);
 
+    if((this->_FREQ == 0) && (NewFREQ < RAMP_MIN_FREQ)) NewFREQ = 0;
 
-    
+    if(NewFREQ != this->_CurrentFREQ) this->FREQ(NewFREQ);
 }
 
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+uint32_t NidecClass::Frequency(void)
+{
+    return this->_CurrentFREQ;
+}
 
-
-
-
-
-
+bool NidecClass::Ramping(void)
+{
+    return this->_CurrentFREQ != this->_FREQ;
+}
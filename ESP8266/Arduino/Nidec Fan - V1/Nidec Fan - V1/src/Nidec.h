@@ -3,7 +3,7 @@
 
 #include <Arduino.h>
 
-#include <os_type.h>
+#include <core_esp8266_waveform.h>
 
 
 //#define DEBUG_NIDEC                                     1
@@ -22,7 +22,14 @@
 
 #define MAXFREQ                                         460
 
-#define PWMSTEP                                         20
+#define PWMSTEP                                         20              //      Default acceleration, Hz per second
+
+/******************************************************************************************************************************
+						
+******************************************************************************************************************************/
+#define RAMP_TICK_MS                                    10              //      Ramp update step
+
+#define RAMP_MIN_FREQ                                   PWMSTEP         //      Lowest running frequency, below it the fan is stopped
 
 /******************************************************************************************************************************
 						
@@ -46,6 +53,17 @@ MODE_CONTROL_t;
 
 /******************************************************************************************************************************
 						
+******************************************************************************************************************************/
+typedef enum
+{
+    RAMP_LINEAR                                         = 0,            //      Constant acceleration
+
+    RAMP_SCURVE                                         = 1,            //      Smoothstep, no acceleration jump at both ends
+}
+RAMP_PROFILE_t;
+
+/******************************************************************************************************************************
+						
 ******************************************************************************************************************************/
 
 class NidecClass
@@ -62,16 +80,27 @@ class NidecClass
         uint8_t                                         _PWMPin;      
 
         uint8_t                                         _BreakPin;  
+
 /******************************************************************************************************************************
 						
 ******************************************************************************************************************************/
-        uint32_t                                        _Reload;
+        RAMP_PROFILE_t                                  _Profile;
+
+        uint16_t                                        _Accel;
 
 /******************************************************************************************************************************
 						
 ******************************************************************************************************************************/
         uint32_t                                        _CurrentFREQ;
 
+        uint32_t                                        _StartFREQ;
+
+        uint32_t                                        _RampStart;
+
+        uint32_t                                        _RampTime;
+
+        uint32_t                                        _LastUpdate;
+
 /******************************************************************************************************************************
 						
 ******************************************************************************************************************************/
@@ -84,14 +113,11 @@ class NidecClass
 
 /******************************************************************************************************************************
 						
-******************************************************************************************************************************/
-        uint8_t                                         _State;
-
-/******************************************************************************************************************************
-						
 ******************************************************************************************************************************/
         void                                            FREQ(uint32_t FREQ_);
 
+        uint32_t                                        RampFREQ(uint32_t Elapsed);
+
 
 /******************************************************************************************************************************
 						
@@ -101,7 +127,9 @@ class NidecClass
 /******************************************************************************************************************************
 						
 ******************************************************************************************************************************/
-        void                                            Begin(uint8_t PWMPin, uint8_t BreakPin);
+        void                                            Begin(uint8_t PWMPin, uint8_t BreakPin, RAMP_PROFILE_t Profile = RAMP_LINEAR, uint16_t Accel = PWMSTEP);
+
+        void                                            Profile(RAMP_PROFILE_t Profile, uint16_t Accel);
 
 /******************************************************************************************************************************
 						
@@ -116,9 +144,11 @@ class NidecClass
 /******************************************************************************************************************************
 						
 ******************************************************************************************************************************/
-        void                                            HandlePWM(void);                
+        void                                            Handle(void);                   //      Call from loop(), steps the ramp
+
+        uint32_t                                        Frequency(void);
 
-        void                                            HandleTICK(void);    
+        bool                                            Ramping(void);
 
 
 
@@ -128,17 +158,4 @@ class NidecClass
 extern NidecClass NIDEC;
 
 
-
-
-
-
-
-
-
-
-void ICACHE_RAM_ATTR TimerPWMFunc(void);
-
-void ICACHE_RAM_ATTR TimerTickFunc(void);
-
-
 #endif
@@ -9,15 +9,6 @@
 
 
 
-/******************************************************************************************************************************
-						
-******************************************************************************************************************************/
-uint8_t SW1Status = false;
-
-uint8_t SW2Status = false;
-
-uint8_t SW3Status = false;
-
 /******************************************************************************************************************************
 						
 ******************************************************************************************************************************/
@@ -54,81 +45,40 @@ uint8_t* Duty = 0;
 
 void setup() 
 {
-    pinMode(SW1, INPUT);
+    NIDEC.Begin(NidecPWM, NidecBreak);
 
-    pinMode(SW2, INPUT);
+    FANINPUT.Begin(MODE_BUTTON);
 
-    pinMode(SW3, INPUT);
+    FANINPUT.AddButton(SW1, FREQSW1);
 
+    FANINPUT.AddButton(SW2, FREQSW2);
 
-    NIDEC.Begin(NidecPWM, NidecBreak);
+    FANINPUT.AddButton(SW3, FREQSW3);
 }
 
 void loop() 
 {
-/*****************************************************************************************************************************/    
-    if((digitalRead(SW1) == HIGH) && (digitalRead(SW2) == HIGH) && (digitalRead(SW3) == HIGH) && ((SW1Status == true) || (SW2Status == true) || (SW3Status == true)))
-    {
-        delay(500);
-
-        SW1Status = false;
-
-        SW2Status = false;
-
-        SW3Status = false;
-
-        Serial.println("Stop");
-
-        NIDEC.Stop();
-    }
-
-/*****************************************************************************************************************************/  
-    if((digitalRead(SW1) == LOW) && (SW1Status == false))
-    {
-        delay(500);
-
-        SW1Status = true;
+    FanEvent_t Event;
 
-        SW2Status = false;
-
-        SW3Status = false;
-
-        NIDEC.Start(FREQSW1);
-    }
-
-/*****************************************************************************************************************************/  
-    if((digitalRead(SW2) == LOW) && (SW2Status == false))
-    {
-        delay(500);
-
-        SW1Status = false;
-
-        SW2Status = true;
-
-        SW3Status = false;
-
-        NIDEC.Start(FREQSW2);
-    }
+/*****************************************************************************************************************************/    
+    FANINPUT.Handle();
 
-/*****************************************************************************************************************************/  
-    if((digitalRead(SW3) == LOW) && (SW3Status == false))
+    while(FANINPUT.Read(&Event))
     {
-        delay(500);
-
-        SW1Status = false;
-
-        SW2Status = false;
-
-        SW3Status = true;
-
-        NIDEC.Start(FREQSW3);      
+        if(Event.FREQ == 0)
+        {
+            Serial.println("Stop");
+
+            NIDEC.Stop();
+        }
+        else
+        {
+            NIDEC.Start(Event.FREQ);
+        }
     }
 
 /*****************************************************************************************************************************/  
-
-   
-
-    
+    NIDEC.Handle();
 
 /******************************************************************************************************************************
 						
@@ -9,6 +9,8 @@
 
 #include "Nidec.h"
 
+#include "FanInput.h"
+
 
 /******************************************************************************************************************************
 						
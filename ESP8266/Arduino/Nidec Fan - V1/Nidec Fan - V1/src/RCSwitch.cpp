@@ -34,6 +34,11 @@
 
 #include "RCSwitch.h"
 
+#if defined(ESP8266)
+    #include <Schedule.h>
+    #include <core_esp8266_waveform.h>
+#endif
+
 #ifdef RaspberryPi
     // PROGMEM and _P functions are for AVR based microprocessors,
     // so we must normalize these for the ARM processor:
@@ -93,16 +98,21 @@ enum {
 };
 
 #if not defined( RCSwitchDisableReceiving )
-volatile unsigned long RCSwitch::nReceivedValue = 0;
-volatile unsigned int RCSwitch::nReceivedBitlength = 0;
-volatile unsigned int RCSwitch::nReceivedDelay = 0;
-volatile unsigned int RCSwitch::nReceivedProtocol = 0;
 int RCSwitch::nReceiveTolerance = 60;
 const unsigned int RCSwitch::nSeparationLimit = 4300;
 // separationLimit: minimum microseconds between received codes, closer codes are ignored.
 // according to discussion on issue #14 it might be more suitable to set the separation
 // limit to the same time as the 'low' part of the sync signal for the current protocol.
 unsigned int RCSwitch::timings[RCSWITCH_MAX_CHANGES];
+volatile uint32_t RCSwitch::edgeRing[RCSWITCH_EDGE_RING];
+volatile uint32_t RCSwitch::edgeHead = 0;
+volatile uint32_t RCSwitch::edgeTail = 0;
+volatile unsigned long RCSwitch::nDroppedEdges = 0;
+RCSwitch::Received RCSwitch::received[RCSWITCH_QUEUE_SIZE];
+unsigned int RCSwitch::nReceivedHead = 0;
+unsigned int RCSwitch::nReceivedCount = 0;
+
+static_assert((RCSWITCH_EDGE_RING & (RCSWITCH_EDGE_RING - 1)) == 0, "RCSWITCH_EDGE_RING must be a power of two");
 #endif
 
 RCSwitch::RCSwitch() {
@@ -112,7 +122,6 @@ RCSwitch::RCSwitch() {
   #if not defined( RCSwitchDisableReceiving )
   this->nReceiverInterrupt = -1;
   this->setReceiveTolerance(60);
-  RCSwitch::nReceivedValue = 0;
   #endif
 }
 
@@ -523,6 +532,177 @@ void RCSwitch::send(unsigned long code, unsigned int length) {
 #endif
 }
 
+RCSwitch::AsyncSend RCSwitch::sendQueue[RCSWITCH_SEND_QUEUE];
+unsigned int RCSwitch::nSendHead = 0;
+unsigned int RCSwitch::nSendCount = 0;
+
+#if defined(ESP8266)
+/*
+ * Pulse train player, run from the timer1 NMI.  The symbol durations are
+ * converted to CPU cycles up front and the edges are scheduled on a running
+ * total, so NMI latency does not accumulate over the train.
+ */
+static struct {
+  uint32_t high[3];            // zero, one, sync
+  uint32_t low[3];
+  uint32_t mask;               // GPIO bit, 0 for GPIO16
+  bool inverted;
+  unsigned long code;
+  int length;
+  int bit;                     // bit being sent, -1 for the sync
+  bool lowHalf;
+  int repeat;                  // frames left
+  uint32_t nextEdge;
+  volatile bool active;        // set by the sender, cleared by the NMI when done
+} tx;
+static bool txBusy = false;    // the head of sendQueue is loaded into tx
+static bool txPolling = false;
+static int txReceiverInterrupt = -1;
+
+static inline ICACHE_RAM_ATTR void txLevel(bool high) {
+  if (tx.mask) {
+    if (high) {
+      GPOS = tx.mask;
+    } else {
+      GPOC = tx.mask;
+    }
+  } else {
+    GP16O = high ? 1 : 0;
+  }
+}
+
+static ICACHE_RAM_ATTR uint32_t txTimer1() {
+  if (!tx.active) {
+    return microsecondsToClockCycles(10000);
+  }
+  int32_t left = tx.nextEdge - ESP.getCycleCount();
+  if (left > 0) {
+    return left;
+  }
+  if (tx.repeat <= 0) {
+    // Leave the transmitter off, as send() does
+    txLevel(false);
+    tx.active = false;
+    return microsecondsToClockCycles(10000);
+  }
+  const int sym = (tx.bit < 0) ? 2 : ((tx.code >> tx.bit) & 1);
+  if (!tx.lowHalf) {
+    txLevel(!tx.inverted);
+    tx.nextEdge += tx.high[sym];
+  } else {
+    txLevel(tx.inverted);
+    tx.nextEdge += tx.low[sym];
+    if (tx.bit < 0) {
+      tx.repeat--;
+      tx.bit = tx.length - 1;
+    } else {
+      tx.bit--;
+    }
+  }
+  tx.lowHalf = !tx.lowHalf;
+  left = tx.nextEdge - ESP.getCycleCount();
+  return (left > 0) ? left : 0;
+}
+
+void RCSwitch::sendStart() {
+  const AsyncSend &s = RCSwitch::sendQueue[RCSwitch::nSendHead];
+
+#if not defined( RCSwitchDisableReceiving )
+  // make sure the receiver is disabled while we transmit
+  txReceiverInterrupt = s.owner->nReceiverInterrupt;
+  if (txReceiverInterrupt != -1) {
+    s.owner->disableReceive();
+  }
+#endif
+  // Also stops any waveform or PWM on the pin, which can't be done from the NMI
+  digitalWrite(s.nTransmitterPin, LOW);
+
+  const HighLow *symbols[3] = { &s.protocol.zero, &s.protocol.one, &s.protocol.syncFactor };
+  for (int i = 0; i < 3; i++) {
+    tx.high[i] = microsecondsToClockCycles((uint32_t)s.protocol.pulseLength * symbols[i]->high);
+    tx.low[i] = microsecondsToClockCycles((uint32_t)s.protocol.pulseLength * symbols[i]->low);
+  }
+  tx.mask = (s.nTransmitterPin < 16) ? (1UL << s.nTransmitterPin) : 0;
+  tx.inverted = s.protocol.invertedSignal;
+  tx.code = s.code;
+  tx.length = s.length;
+  tx.bit = s.length - 1;
+  tx.lowHalf = false;
+  tx.repeat = s.nRepeatTransmit;
+  tx.nextEdge = ESP.getCycleCount() + microsecondsToClockCycles(10);
+  tx.active = true;
+  txBusy = true;
+  setTimer1Callback(txTimer1);
+}
+
+bool RCSwitch::sendPoll() {
+  if (tx.active) {
+    return true;
+  }
+  if (txBusy) {
+    AsyncSend s = RCSwitch::sendQueue[RCSwitch::nSendHead];
+    RCSwitch::nSendHead = (RCSwitch::nSendHead + 1) % RCSWITCH_SEND_QUEUE;
+    RCSwitch::nSendCount--;
+    txBusy = false;
+#if not defined( RCSwitchDisableReceiving )
+    // enable receiver again if we just disabled it
+    if (txReceiverInterrupt != -1) {
+      s.owner->enableReceive(txReceiverInterrupt);
+    }
+#endif
+    if (s.callback) {
+      s.callback(s.code, s.arg);
+    }
+  }
+  if (RCSwitch::nSendCount) {
+    RCSwitch::sendStart();
+    return true;
+  }
+  setTimer1Callback(NULL);
+  txPolling = false;
+  return false;
+}
+#endif
+
+bool RCSwitch::sendAsync(unsigned long code, unsigned int length, SendCallback callback, void* arg) {
+  if (this->nTransmitterPin == -1 || RCSwitch::nSendCount == RCSWITCH_SEND_QUEUE) {
+    return false;
+  }
+#if defined(ESP8266)
+  if (this->nTransmitterPin > 16) {
+    return false;
+  }
+  AsyncSend &s = RCSwitch::sendQueue[(RCSwitch::nSendHead + RCSwitch::nSendCount) % RCSWITCH_SEND_QUEUE];
+  s.owner = this;
+  s.code = code;
+  s.length = length;
+  s.nTransmitterPin = this->nTransmitterPin;
+  s.nRepeatTransmit = this->nRepeatTransmit;
+  s.protocol = this->protocol;
+  s.callback = callback;
+  s.arg = arg;
+  if (!txPolling) {
+    // Started, and later completed, from loop context
+    txPolling = schedule_recurrent_function_us(RCSwitch::sendPoll, 1000);
+    if (!txPolling) {
+      return false;
+    }
+  }
+  RCSwitch::nSendCount++;
+  return true;
+#else
+  this->send(code, length);
+  if (callback) {
+    callback(code, arg);
+  }
+  return true;
+#endif
+}
+
+bool RCSwitch::sendingAsync() {
+  return RCSwitch::nSendCount != 0;
+}
+
 /**
  * Transmit a single high-low pulse.
  */
@@ -548,8 +728,15 @@ void RCSwitch::enableReceive(int interrupt) {
 
 void RCSwitch::enableReceive() {
   if (this->nReceiverInterrupt != -1) {
-    RCSwitch::nReceivedValue = 0;
-    RCSwitch::nReceivedBitlength = 0;
+    RCSwitch::nReceivedCount = 0;
+    RCSwitch::edgeTail = RCSwitch::edgeHead;
+#if defined(ESP8266)
+    // Decode in the background, available() also decodes whatever is pending
+    static bool scheduled = false;
+    if (!scheduled) {
+      scheduled = schedule_recurrent_function_us([]() { RCSwitch::decode(); return true; }, RCSWITCH_DECODE_US);
+    }
+#endif
 #if defined(RaspberryPi) // Raspberry Pi
     wiringPiISR(this->nReceiverInterrupt, INT_EDGE_BOTH, &handleInterrupt);
 #else // Arduino
@@ -568,34 +755,49 @@ void RCSwitch::disableReceive() {
   this->nReceiverInterrupt = -1;
 }
 
+/**
+ * Codes are queued, the getReceived*() calls return the oldest one and
+ * resetAvailable() moves on to the next.
+ */
 bool RCSwitch::available() {
-  return RCSwitch::nReceivedValue != 0;
+  RCSwitch::decode();
+  return RCSwitch::nReceivedCount != 0;
 }
 
 void RCSwitch::resetAvailable() {
-  RCSwitch::nReceivedValue = 0;
+  if (RCSwitch::nReceivedCount) {
+    RCSwitch::nReceivedHead = (RCSwitch::nReceivedHead + 1) % RCSWITCH_QUEUE_SIZE;
+    RCSwitch::nReceivedCount--;
+  }
 }
 
 unsigned long RCSwitch::getReceivedValue() {
-  return RCSwitch::nReceivedValue;
+  return RCSwitch::nReceivedCount ? RCSwitch::received[RCSwitch::nReceivedHead].value : 0;
 }
 
 unsigned int RCSwitch::getReceivedBitlength() {
-  return RCSwitch::nReceivedBitlength;
+  return RCSwitch::nReceivedCount ? RCSwitch::received[RCSwitch::nReceivedHead].bitlength : 0;
 }
 
 unsigned int RCSwitch::getReceivedDelay() {
-  return RCSwitch::nReceivedDelay;
+  return RCSwitch::nReceivedCount ? RCSwitch::received[RCSwitch::nReceivedHead].delay : 0;
 }
 
 unsigned int RCSwitch::getReceivedProtocol() {
-  return RCSwitch::nReceivedProtocol;
+  return RCSwitch::nReceivedCount ? RCSwitch::received[RCSwitch::nReceivedHead].protocol : 0;
 }
 
 unsigned int* RCSwitch::getReceivedRawdata() {
   return RCSwitch::timings;
 }
 
+/**
+ * Edges lost because the decoder did not keep up with the interrupt
+ */
+unsigned long RCSwitch::getDroppedEdges() {
+  return RCSwitch::nDroppedEdges;
+}
+
 /* helper function for the receiveProtocol method */
 static inline unsigned int diff(int A, int B) {
   return abs(A - B);
@@ -604,7 +806,7 @@ static inline unsigned int diff(int A, int B) {
 /**
  *
  */
-bool RECEIVE_ATTR RCSwitch::receiveProtocol(const int p, unsigned int changeCount) {
+bool RCSwitch::receiveProtocol(const int p, unsigned int changeCount) {
 #if defined(ESP8266) || defined(ESP32)
     const Protocol &pro = proto[p-1];
 #else
@@ -653,25 +855,67 @@ bool RECEIVE_ATTR RCSwitch::receiveProtocol(const int p, unsigned int changeCoun
     }
 
     if (changeCount > 7) {    // ignore very short transmissions: no device sends them, so this must be noise
-        RCSwitch::nReceivedValue = code;
-        RCSwitch::nReceivedBitlength = (changeCount - 1) / 2;
-        RCSwitch::nReceivedDelay = delay;
-        RCSwitch::nReceivedProtocol = p;
+        if (RCSwitch::nReceivedCount == RCSWITCH_QUEUE_SIZE) {
+            // Nobody is reading, drop the oldest
+            RCSwitch::nReceivedHead = (RCSwitch::nReceivedHead + 1) % RCSWITCH_QUEUE_SIZE;
+            RCSwitch::nReceivedCount--;
+        }
+        Received &r = RCSwitch::received[(RCSwitch::nReceivedHead + RCSwitch::nReceivedCount) % RCSWITCH_QUEUE_SIZE];
+        r.value = code;
+        r.bitlength = (changeCount - 1) / 2;
+        r.delay = delay;
+        r.protocol = p;
+        RCSwitch::nReceivedCount++;
         return true;
     }
 
     return false;
 }
 
+/* Edge timestamps: CPU cycles where available, they are cheaper to read than micros() */
+static inline RECEIVE_ATTR uint32_t edgeTime() {
+#if defined(ESP8266) || defined(ESP32)
+  return ESP.getCycleCount();
+#else
+  return micros();
+#endif
+}
+
+static inline uint32_t edgeTicksPerMicrosecond() {
+#if defined(ESP8266) || defined(ESP32)
+  return ESP.getCpuFreqMHz();
+#else
+  return 1;
+#endif
+}
+
 void RECEIVE_ATTR RCSwitch::handleInterrupt() {
+  const uint32_t head = RCSwitch::edgeHead;
+  if (head - RCSwitch::edgeTail >= RCSWITCH_EDGE_RING) {
+    RCSwitch::nDroppedEdges++;
+    return;
+  }
+  RCSwitch::edgeRing[head & (RCSWITCH_EDGE_RING - 1)] = edgeTime();
+  RCSwitch::edgeHead = head + 1;
+}
+
+void RCSwitch::decode() {
+  static uint32_t lastTime = 0;
+  const uint32_t ticks = edgeTicksPerMicrosecond();
+
+  while (RCSwitch::edgeTail != RCSwitch::edgeHead) {
+    const uint32_t time = RCSwitch::edgeRing[RCSwitch::edgeTail & (RCSWITCH_EDGE_RING - 1)];
+    RCSwitch::edgeTail++;
+    handleEdge((time - lastTime) / ticks);
+    lastTime = time;
+  }
+}
+
+void RCSwitch::handleEdge(unsigned int duration) {
 
   static unsigned int changeCount = 0;
-  static unsigned long lastTime = 0;
   static unsigned int repeatCount = 0;
 
-  const long time = micros();
-  const unsigned int duration = time - lastTime;
-
   if (duration > RCSwitch::nSeparationLimit) {
     // A long stretch without signal level change occurred. This could
     // be the gap between two transmission.
@@ -702,6 +946,5 @@ void RECEIVE_ATTR RCSwitch::handleInterrupt() {
   }
 
   RCSwitch::timings[changeCount++] = duration;
-  lastTime = time;  
 }
 #endif
@@ -60,6 +60,27 @@
 // We can handle up to (unsigned long) => 32 bit * 2 H/L changes per bit + 2 for sync
 #define RCSWITCH_MAX_CHANGES 67
 
+// Edge timestamps buffered between the receive interrupt and the decoder,
+// must be a power of two.
+#ifndef RCSWITCH_EDGE_RING
+#define RCSWITCH_EDGE_RING 256
+#endif
+
+// Decoded codes waiting to be read with getReceivedValue()/resetAvailable()
+#ifndef RCSWITCH_QUEUE_SIZE
+#define RCSWITCH_QUEUE_SIZE 8
+#endif
+
+// Interval of the decoder run from the scheduler (ESP8266)
+#ifndef RCSWITCH_DECODE_US
+#define RCSWITCH_DECODE_US 5000
+#endif
+
+// Commands waiting to be sent by sendAsync()
+#ifndef RCSWITCH_SEND_QUEUE
+#define RCSWITCH_SEND_QUEUE 4
+#endif
+
 class RCSwitch {
 
   public:
@@ -79,6 +100,17 @@ class RCSwitch {
     void sendTriState(const char* sCodeWord);
     void send(unsigned long code, unsigned int length);
     void send(const char* sCodeWord);
+
+    /**
+     * Queue a code to be sent in the background.  On ESP8266 the pulses are
+     * played from the timer1 NMI through setTimer1Callback(), so nothing
+     * else may use that callback while sending.  The callback is called from
+     * loop context once the code has been sent nRepeatTransmit times.
+     * Elsewhere this falls back to the blocking send().
+     */
+    typedef void (*SendCallback)(unsigned long code, void* arg);
+    bool sendAsync(unsigned long code, unsigned int length, SendCallback callback = NULL, void* arg = NULL);
+    static bool sendingAsync();
     
     #if not defined( RCSwitchDisableReceiving )
     void enableReceive(int interrupt);
@@ -92,6 +124,7 @@ class RCSwitch {
     unsigned int getReceivedDelay();
     unsigned int getReceivedProtocol();
     unsigned int* getReceivedRawdata();
+    unsigned long getDroppedEdges();
     #endif
   
     void enableTransmit(int nTransmitterPin);
@@ -149,6 +182,22 @@ class RCSwitch {
     void setProtocol(int nProtocol, int nPulseLength);
 
   private:
+    struct AsyncSend {
+        RCSwitch* owner;
+        unsigned long code;
+        unsigned int length;
+        int nTransmitterPin;
+        int nRepeatTransmit;
+        Protocol protocol;
+        SendCallback callback;
+        void* arg;
+    };
+    static AsyncSend sendQueue[RCSWITCH_SEND_QUEUE];
+    static unsigned int nSendHead;
+    static unsigned int nSendCount;
+    static bool sendPoll();
+    static void sendStart();
+
     char* getCodeWordA(const char* sGroup, const char* sDevice, bool bStatus);
     char* getCodeWordB(int nGroupNumber, int nSwitchNumber, bool bStatus);
     char* getCodeWordC(char sFamily, int nGroup, int nDevice, bool bStatus);
@@ -157,6 +206,8 @@ class RCSwitch {
 
     #if not defined( RCSwitchDisableReceiving )
     static void handleInterrupt();
+    static void decode();
+    static void handleEdge(unsigned int duration);
     static bool receiveProtocol(const int p, unsigned int changeCount);
     int nReceiverInterrupt;
     #endif
@@ -167,11 +218,27 @@ class RCSwitch {
 
     #if not defined( RCSwitchDisableReceiving )
     static int nReceiveTolerance;
-    volatile static unsigned long nReceivedValue;
-    volatile static unsigned int nReceivedBitlength;
-    volatile static unsigned int nReceivedDelay;
-    volatile static unsigned int nReceivedProtocol;
     const static unsigned int nSeparationLimit;
+
+    /*
+     * The interrupt only timestamps edges into edgeRing (the only writer of
+     * edgeHead), decode() turns them into durations and codes outside of it
+     * (the only writer of edgeTail).
+     */
+    volatile static uint32_t edgeRing[RCSWITCH_EDGE_RING];
+    volatile static uint32_t edgeHead;
+    volatile static uint32_t edgeTail;
+    volatile static unsigned long nDroppedEdges;
+
+    struct Received {
+        unsigned long value;
+        unsigned int bitlength;
+        unsigned int delay;
+        unsigned int protocol;
+    };
+    static Received received[RCSWITCH_QUEUE_SIZE];
+    static unsigned int nReceivedHead;
+    static unsigned int nReceivedCount;
     /* 
      * timings[0] contains sync timing, followed by a number of bits
      */